@@ -2,6 +2,7 @@
 
 #include <string>
 #include <vector>
+#include <cstdint>
 
 class BlockType
 {
@@ -12,11 +13,13 @@ public:
     bool isTransparent;
     bool isAir;
     bool isLiquid;
+    uint8_t id = 0; // Index into blockTypes, so voxels can be told apart without comparing names
 
     BlockType() : textures({}), isSolid(false), name("air"), isAir(true) {}
 
-    BlockType(std::vector<unsigned int> textures, bool isSolid, std::string name, bool isTransparent = false, bool isAir = false, bool isLiquid = false)
+    BlockType(uint8_t id, std::vector<unsigned int> textures, bool isSolid, std::string name, bool isTransparent = false, bool isAir = false, bool isLiquid = false)
     {
+        this->id = id;
         this->textures = textures;
         this->isSolid = isSolid;
         this->name = name;
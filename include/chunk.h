@@ -1,14 +1,13 @@
 #pragma once
 
-#include <glad/glad.h>
-#include <GLFW/glfw3.h>
-
 #include <vector>
-#include <glm/glm.hpp>
-#include <glm/gtc/matrix_transform.hpp>
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
 
 #include "voxelData.h"
-#include "shader.h"
+#include "jobs.h"
+#include "memoryStats.h"
 
 struct ChunkCoord
 {
@@ -41,57 +40,132 @@ namespace std
 
 class World;
 
+// How far a chunk has got through the generation pipeline (see World::requestMesh)
+enum ChunkStage
+{
+    STAGE_EMPTY,
+    STAGE_GENERATED, // Terrain, caves and lodes: reads noise, writes only this chunk
+    STAGE_DECORATED, // Trees, which also write into the neighbouring chunks
+    STAGE_MESHED     // Voxels are final; only now do voxel queries and edits see the chunk
+};
+
+// First byte of a region store payload
+enum PayloadKind
+{
+    PAYLOAD_EDITS, // Just the player's edits; the rest of the chunk is generated again
+    PAYLOAD_WHOLE  // Every block as well, from the pregen tool, so loading skips terrain generation
+};
+
+// Mesh for one sectionHeight-tall slice of a chunk, so an edit only rebuilds the slice it touched.
+// Built on a job worker or the simulation thread, guarded by Chunk::meshMutex. ChunkRenderer copies
+// it to the GPU.
+struct ChunkSection
+{
+    std::vector<float> vertices;
+    bool needsUpload = false;
+};
+
 class Chunk
 {
 public:
     ChunkCoord coord;
     std::vector<std::vector<std::vector<BlockType>>> voxelMap;
-    bool shouldRegen;
-    bool treesGenerated;
-    bool cavesGenerated;
-    bool lodesGenerated;
 
-    std::vector<float> vertices;
-    int vertexCount = 0;
+    std::atomic<int> stage{STAGE_EMPTY};
+    std::atomic<bool> cancelled{false}; // Pipeline jobs for this chunk skip their work
+    std::atomic<int> lodeVersion{0};     // World::lodeVersion the ore stage last ran with
+    std::atomic<bool> unsaved{false};    // Edited since it was loaded, so unloading saves it
+
+    // Player edits by voxelIndex, the only part of a chunk that is saved: the rest regenerates the same
+    // every time. Filled by the generate job from the region store, then by setVoxel on the simulation thread.
+    std::unordered_map<int, uint8_t> edits;
+
+    // Simulation thread only
+    JobHandle generateJob, decorateJob, meshJob, lodeJob;
+
+    std::mutex decorateMutex; // Held by any decorate job that may place trees in this chunk
+
+    // Simulation thread only. While a chunk is cold its voxelMap is freed and its blocks are kept here,
+    // run-length coded; World::getChunk thaws it on the next access. Meshes are kept either way.
+    std::vector<uint8_t> packed;
+    double lastAccess = 0.0; // World::accessTime when getChunk last returned it, 0 until it is first ready
+
+    std::vector<ChunkSection> sections;
+    std::mutex meshMutex;
+    std::atomic<bool> meshReady{false}; // Some section has vertices waiting for ChunkRenderer::uploadNextSection
 
-    Chunk() : world(nullptr), coord(ChunkCoord(0, 0)) {}
+    Chunk() : coord(ChunkCoord(0, 0)), world(nullptr) {}
 
-    Chunk(World* world, ChunkCoord coord, bool gen = false)
+    Chunk(World* world, ChunkCoord coord)
     {
         this->world = world;
         this->coord = coord;
-        VAO = 0;
-        VBO = 0;
-        shouldRegen = gen;
-        treesGenerated = false;
-        cavesGenerated = false;
-        lodesGenerated = false;
+        sections.resize(chunkHeight / sectionHeight);
     }
 
+    bool isReady() const
+    {
+        return stage >= STAGE_MESHED;
+    }
+
+    bool isCold() const
+    {
+        return !packed.empty();
+    }
+
+    void freeze();
+    void thaw();
+
+    // Heap taken by an expanded voxelMap, for the cold chunk stats
+    static size_t expandedBytes();
+
+    // Simulation thread. Voxels and edits are only counted once the chunk is generated, since until then a
+    // generate job may be filling them.
+    ChunkMemory memoryUsage();
+
     void populateVoxelMap();
 
-    void generateMesh();
+    // Block indices into blockTypes, [x][z][y] with y fastest
+    void getBlocks(std::vector<uint8_t> &blocks);
 
-    void renderChunk(Shader *shader, const glm::mat4 &view, const glm::mat4 &projection)
+    static int voxelIndex(int x, int y, int z)
     {
-        if (vertexCount == 0) return;
+        return (x * chunkWidth + z) * chunkHeight + y;
+    }
 
-        glm::mat4 model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(coord.x * chunkWidth, 0.0f, coord.z * chunkWidth));
+    // Sets every voxel from block indices laid out as getBlocks gives them
+    void setBlocks(const uint8_t *blocks);
 
-        shader->use();
-        shader->setMat4("model", model);
-        shader->setMat4("view", view);
-        shader->setMat4("projection", projection);
+    // Region store payload: the kind byte, then the edits as varint (index gap, block) pairs in index order.
+    // writeWhole follows them with getBlocks, run-length coded.
+    void writeEdits(std::vector<uint8_t> &payload);
+    void writeWhole(std::vector<uint8_t> &payload);
 
-        glBindVertexArray(VAO);
-        glDrawArrays(GL_TRIANGLES, 0, vertexCount);
-        glBindVertexArray(0);
+    static bool isWholePayload(const std::vector<uint8_t> &payload)
+    {
+        return !payload.empty() && payload[0] == PAYLOAD_WHOLE;
     }
 
+    // Reads a payload into edits and applies them, after setting every block first if it is whole. An edits
+    // payload needs the chunk generated already. Returns false, changing nothing, if it is malformed.
+    bool readPayload(const std::vector<uint8_t> &payload);
+
+    // neighbours holds the chunks across the four side faces, in faceChecks order (+z, -z, +x, -x),
+    // nullptr where there is none. Only their border voxels are read.
+    void generateMesh(Chunk *const neighbours[4]);
+
+    void generateSectionMesh(int section, Chunk *const neighbours[4]);
+
     void setVoxel(int localX, int localY, int localZ, unsigned int block);
 
+    // Keeps a voxel the player changed, through setVoxel or a bulk edit, so it is saved and generation
+    // stages run again later leave it alone
+    void recordEdit(int localX, int localY, int localZ, uint8_t block)
+    {
+        edits[voxelIndex(localX, localY, localZ)] = block;
+        unsaved = true;
+    }
+
 private:
     World* world;
-    unsigned int VAO, VBO;
 };
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <unordered_set>
+#include <cmath>
+#include <glm/glm.hpp>
+
+#include "chunk.h"
+
+// Chunks waiting to be handed to the job system, nearest and most in view first.
+// A binary heap on priorities computed against the focus given to setFocus, so moving the focus
+// re-sorts everything once instead of on every pop.
+class ChunkQueue
+{
+public:
+    // How much a chunk straight behind the camera is held back: it waits like one (1 + viewWeight)
+    // times as far away in front
+    float viewWeight = 1.0f;
+
+    void setFocus(ChunkCoord centre, glm::vec3 forward)
+    {
+        focus = centre;
+        focusForward = glm::vec2(forward.x, forward.z);
+        if (glm::length(focusForward) > 0.0f)
+            focusForward = glm::normalize(focusForward);
+
+        for (Entry &entry : heap)
+            entry.priority = priorityOf(entry.coord);
+        std::make_heap(heap.begin(), heap.end(), later);
+    }
+
+    // Whether the camera has turned far enough from the focus direction that the order is off
+    bool isFocusStale(glm::vec3 forward, float minCos = 0.7f) const
+    {
+        glm::vec2 flat(forward.x, forward.z);
+        if (glm::length(flat) == 0.0f || glm::length(focusForward) == 0.0f)
+            return false;
+
+        return glm::dot(glm::normalize(flat), focusForward) < minCos;
+    }
+
+    void push(ChunkCoord coord)
+    {
+        if (!members.insert(coord).second)
+            return;
+
+        heap.push_back(Entry{priorityOf(coord), coord});
+        std::push_heap(heap.begin(), heap.end(), later);
+    }
+
+    ChunkCoord pop()
+    {
+        std::pop_heap(heap.begin(), heap.end(), later);
+        ChunkCoord coord = heap.back().coord;
+        heap.pop_back();
+        members.erase(coord);
+        return coord;
+    }
+
+    template <typename Fn>
+    void removeIf(Fn shouldRemove)
+    {
+        size_t before = heap.size();
+        heap.erase(std::remove_if(heap.begin(), heap.end(), [&](const Entry &entry)
+                                  {
+            if (!shouldRemove(entry.coord))
+                return false;
+            members.erase(entry.coord);
+            return true; }),
+                   heap.end());
+
+        if (heap.size() != before)
+            std::make_heap(heap.begin(), heap.end(), later);
+    }
+
+    bool contains(ChunkCoord coord) const
+    {
+        return members.find(coord) != members.end();
+    }
+
+    size_t size() const
+    {
+        return heap.size();
+    }
+
+    size_t memoryBytes() const
+    {
+        return heap.capacity() * sizeof(Entry) + hashContainerBytes(members, sizeof(ChunkCoord));
+    }
+
+    bool empty() const
+    {
+        return heap.empty();
+    }
+
+    void clear()
+    {
+        heap.clear();
+        members.clear();
+    }
+
+private:
+    struct Entry
+    {
+        float priority; // Lower is sooner
+        ChunkCoord coord;
+    };
+
+    std::vector<Entry> heap;
+    std::unordered_set<ChunkCoord> members;
+
+    ChunkCoord focus;
+    glm::vec2 focusForward = glm::vec2(0.0f, 1.0f);
+
+    float priorityOf(ChunkCoord coord) const
+    {
+        float dx = (float)(coord.x - focus.x);
+        float dz = (float)(coord.z - focus.z);
+        float distance = std::sqrt(dx * dx + dz * dz);
+        if (distance == 0.0f)
+            return 0.0f;
+
+        float facing = (dx * focusForward.x + dz * focusForward.y) / distance; // 1 ahead, -1 behind
+        return distance * (1.0f + viewWeight * (1.0f - facing) * 0.5f);
+    }
+
+    // Orders the heap with the lowest priority on top
+    static bool later(const Entry &a, const Entry &b)
+    {
+        return a.priority > b.priority;
+    }
+};
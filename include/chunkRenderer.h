@@ -0,0 +1,46 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <vector>
+#include <unordered_map>
+#include <glm/glm.hpp>
+
+#include "chunk.h"
+#include "shader.h"
+
+// GPU buffers for one ChunkSection
+struct SectionBuffers
+{
+    int vertexCount = 0;
+    unsigned int VAO = 0, VBO = 0;
+};
+
+// The GPU side of chunks, render thread only. Chunks build their section meshes into CPU buffers
+// anywhere; this copies them into vertex buffers and draws them.
+class ChunkRenderer
+{
+public:
+    ChunkRenderer() {}
+    ~ChunkRenderer();
+
+    // Copies one freshly built section mesh of chunk to the GPU. Returns false when none is waiting.
+    bool uploadNextSection(Chunk *chunk);
+
+    void render(Chunk *chunk, Shader *shader, const glm::mat4 &view, const glm::mat4 &projection);
+
+    // Frees the buffers of a chunk that is about to be deleted
+    void release(Chunk *chunk);
+
+    // Bytes in section vertex buffers
+    size_t gpuBytes() const
+    {
+        return bufferBytes;
+    }
+
+private:
+    size_t bufferBytes = 0;
+
+    std::unordered_map<const Chunk *, std::vector<SectionBuffers>> meshes;
+};
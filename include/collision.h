@@ -0,0 +1,188 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <glm/glm.hpp>
+
+#include "voxelData.h"
+#include "world.h"
+
+struct AABB
+{
+    glm::vec3 min;
+    glm::vec3 max;
+
+    AABB(glm::vec3 min = glm::vec3(0.0f), glm::vec3 max = glm::vec3(0.0f)) : min(min), max(max) {}
+
+    void translate(int axis, float amount)
+    {
+        min[axis] += amount;
+        max[axis] += amount;
+    }
+
+    // True when the boxes overlap on the two axes other than `axis`. Touching, or overlapping by
+    // less than the rounding left over from a previous clip, does not count.
+    bool overlapsAcross(const AABB &other, int axis, float epsilon = 1e-4f) const
+    {
+        for (int a = 0; a < 3; a++)
+        {
+            if (a == axis)
+                continue;
+            if (max[a] <= other.min[a] + epsilon || min[a] >= other.max[a] - epsilon)
+                return false;
+        }
+        return true;
+    }
+
+    // Clips a move along `axis` so this box stops flush against `other` instead of entering it
+    float clipMotion(const AABB &other, int axis, float motion) const
+    {
+        const float epsilon = 1e-4f;
+
+        if (!overlapsAcross(other, axis))
+            return motion;
+
+        if (motion > 0.0f && max[axis] <= other.min[axis] + epsilon)
+            motion = std::min(motion, other.min[axis] - max[axis]);
+        else if (motion < 0.0f && min[axis] >= other.max[axis] - epsilon)
+            motion = std::max(motion, other.max[axis] - min[axis]);
+
+        return motion;
+    }
+};
+
+struct SweepResult
+{
+    bool collided[3] = {false, false, false};
+    bool grounded = false;
+    bool stepped = false;
+};
+
+// Collects a box for every solid voxel overlapping `area`. Voxels are centred on integer
+// coordinates, matching the mesh and World::isVoxelSolid (outside the world counts as solid).
+// Chunks are read through World::peekChunk, so several threads can collide at once; a cold chunk
+// counts as empty, so the caller thaws the ones in reach first.
+inline void gatherSolidVoxels(World &world, const AABB &area, std::vector<AABB> &out)
+{
+    out.clear();
+
+    glm::ivec3 lo = glm::ivec3(glm::floor(area.min + glm::vec3(0.5f)));
+    glm::ivec3 hi = glm::ivec3(glm::floor(area.max + glm::vec3(0.5f)));
+
+    ChunkCoord cachedCoord(-1, -1);
+    Chunk *cachedChunk = nullptr;
+
+    for (int x = lo.x; x <= hi.x; x++)
+    {
+        for (int z = lo.z; z <= hi.z; z++)
+        {
+            bool outside = x < 0 || z < 0 || x >= worldWidth * chunkWidth || z >= worldWidth * chunkWidth;
+
+            if (!outside)
+            {
+                ChunkCoord coord(x / chunkWidth, z / chunkWidth);
+                if (!(coord == cachedCoord))
+                {
+                    cachedCoord = coord;
+                    cachedChunk = world.peekChunk(coord);
+                }
+
+                if (cachedChunk == nullptr)
+                    continue;
+            }
+
+            for (int y = std::max(lo.y, 0); y <= std::min(hi.y, chunkHeight - 1); y++)
+            {
+                if (outside || cachedChunk->voxelMap[x % chunkWidth][y][z % chunkWidth].isSolid)
+                    out.push_back(AABB(glm::vec3(x - 0.5f, y - 0.5f, z - 0.5f), glm::vec3(x + 0.5f, y + 0.5f, z + 0.5f)));
+            }
+        }
+    }
+}
+
+// Moves `box` by motion, one axis at a time (Y, X, Z), stopping each axis at its exact time of impact
+inline glm::vec3 resolveMotion(AABB &box, glm::vec3 motion, const std::vector<AABB> &solids, SweepResult &result)
+{
+    const int order[3] = {1, 0, 2};
+
+    for (int axis : order)
+    {
+        float wanted = motion[axis];
+        if (wanted == 0.0f)
+            continue;
+
+        float allowed = wanted;
+        for (const AABB &solid : solids)
+            allowed = box.clipMotion(solid, axis, allowed);
+
+        box.translate(axis, allowed);
+        motion[axis] = allowed;
+
+        if (allowed != wanted)
+            result.collided[axis] = true;
+    }
+
+    return motion;
+}
+
+// Swept AABB move against the voxel grid. The voxels the whole move could touch are gathered
+// once, then each axis is resolved against that list. With stepHeight > 0 a grounded box that
+// is blocked horizontally also tries the move raised by up to stepHeight and keeps whichever
+// result travelled further. Velocity is zeroed on blocked axes. Usable for any entity.
+inline SweepResult sweepAABB(World &world, AABB &box, glm::vec3 &velocity, float dt, float stepHeight = 0.0f, bool wasGrounded = false)
+{
+    thread_local std::vector<AABB> solids;
+
+    SweepResult result;
+    glm::vec3 motion = velocity * dt;
+
+    AABB area(glm::min(box.min, box.min + motion), glm::max(box.max, box.max + motion));
+    if (stepHeight > 0.0f)
+        area.max.y += stepHeight;
+    gatherSolidVoxels(world, area, solids);
+
+    AABB start = box;
+    glm::vec3 moved = resolveMotion(box, motion, solids, result);
+
+    bool blockedSideways = result.collided[0] || result.collided[2];
+    bool onGround = wasGrounded || (result.collided[1] && motion.y < 0.0f);
+
+    if (stepHeight > 0.0f && blockedSideways && onGround)
+    {
+        SweepResult stepResult;
+        AABB stepBox = start;
+
+        // Up, across, then back down onto whatever is there
+        glm::vec3 stepMotion(motion.x, stepHeight, motion.z);
+        glm::vec3 stepMoved = resolveMotion(stepBox, stepMotion, solids, stepResult);
+
+        float drop = -stepMoved.y + std::min(motion.y, 0.0f);
+        float allowed = drop;
+        for (const AABB &solid : solids)
+            allowed = stepBox.clipMotion(solid, 1, allowed);
+        stepBox.translate(1, allowed);
+
+        float flat = moved.x * moved.x + moved.z * moved.z;
+        float stepped = stepMoved.x * stepMoved.x + stepMoved.z * stepMoved.z;
+
+        if (stepped > flat + 1e-6f)
+        {
+            box = stepBox;
+            result.collided[0] = stepResult.collided[0];
+            result.collided[2] = stepResult.collided[2];
+            result.collided[1] = allowed != drop;
+            result.stepped = true;
+        }
+    }
+
+    for (int axis = 0; axis < 3; axis++)
+    {
+        if (result.collided[axis])
+            velocity[axis] = 0.0f;
+    }
+
+    result.grounded = (result.collided[1] && motion.y < 0.0f) || result.stepped;
+
+    return result;
+}
@@ -0,0 +1,266 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <unordered_map>
+#include <unordered_set>
+#include <glm/glm.hpp>
+
+#include "voxelData.h"
+#include "world.h"
+#include "collision.h"
+
+enum EntityType
+{
+    ENTITY_MOB,
+    ENTITY_ITEM
+};
+
+// Every simulated entity other than the player. State is kept as parallel arrays (struct of arrays)
+// so the integration loop runs over contiguous floats and vectorises, and collision can be split
+// across the world's job workers by chunk region without any two of them touching the same entity.
+class EntityStore
+{
+public:
+    std::vector<float> posX, posY, posZ; // Feet centre
+    std::vector<float> prevX, prevY, prevZ; // Position before the last step, for render interpolation
+    std::vector<float> velX, velY, velZ;
+    std::vector<float> halfWidth, height, stepHeight;
+    std::vector<uint8_t> type, grounded, inWater;
+
+    int regionChunks = 4;      // Entities are bucketed per regionChunks x regionChunks chunks
+    int entitiesPerThread = 256;
+    float killHeight = -64.0f;
+
+    size_t count() const
+    {
+        return posX.size();
+    }
+
+    size_t spawn(EntityType entityType, glm::vec3 pos, glm::vec3 vel = glm::vec3(0.0f))
+    {
+        bool item = entityType == ENTITY_ITEM;
+
+        posX.push_back(pos.x);
+        posY.push_back(pos.y);
+        posZ.push_back(pos.z);
+        prevX.push_back(pos.x);
+        prevY.push_back(pos.y);
+        prevZ.push_back(pos.z);
+        velX.push_back(vel.x);
+        velY.push_back(vel.y);
+        velZ.push_back(vel.z);
+        halfWidth.push_back(item ? 0.125f : 0.3f);
+        height.push_back(item ? 0.25f : 1.8f);
+        stepHeight.push_back(item ? 0.0f : 0.6f);
+        type.push_back((uint8_t)entityType);
+        grounded.push_back(0);
+        inWater.push_back(0);
+
+        return count() - 1;
+    }
+
+    // Swap-remove: the last entity takes over `index`
+    void despawn(size_t index)
+    {
+        size_t last = count() - 1;
+        if (index != last)
+        {
+            posX[index] = posX[last];
+            posY[index] = posY[last];
+            posZ[index] = posZ[last];
+            prevX[index] = prevX[last];
+            prevY[index] = prevY[last];
+            prevZ[index] = prevZ[last];
+            velX[index] = velX[last];
+            velY[index] = velY[last];
+            velZ[index] = velZ[last];
+            halfWidth[index] = halfWidth[last];
+            height[index] = height[last];
+            stepHeight[index] = stepHeight[last];
+            type[index] = type[last];
+            grounded[index] = grounded[last];
+            inWater[index] = inWater[last];
+        }
+
+        posX.pop_back();
+        posY.pop_back();
+        posZ.pop_back();
+        prevX.pop_back();
+        prevY.pop_back();
+        prevZ.pop_back();
+        velX.pop_back();
+        velY.pop_back();
+        velZ.pop_back();
+        halfWidth.pop_back();
+        height.pop_back();
+        stepHeight.pop_back();
+        type.pop_back();
+        grounded.pop_back();
+        inWater.pop_back();
+    }
+
+    glm::vec3 getRenderPosition(size_t index, float alpha) const
+    {
+        return glm::mix(glm::vec3(prevX[index], prevY[index], prevZ[index]), glm::vec3(posX[index], posY[index], posZ[index]), alpha);
+    }
+
+    void clear()
+    {
+        while (count() > 0)
+            despawn(count() - 1);
+    }
+
+    // One physics step for every entity. The world must not be modified until it returns.
+    void step(World &world, float dt)
+    {
+        if (count() == 0)
+            return;
+
+        prevX = posX;
+        prevY = posY;
+        prevZ = posZ;
+
+        integrate(dt);
+
+        // Collision below may run on several threads, which must not thaw chunks under each other, so
+        // every chunk an entity could touch this step is looked up (and thawed) here first. An entity
+        // moves less than a chunk per step.
+        std::unordered_set<ChunkCoord> occupied;
+        for (size_t i = 0; i < count(); i++)
+            occupied.insert(ChunkCoord((int)floor(posX[i] / chunkWidth), (int)floor(posZ[i] / chunkWidth)));
+
+        std::unordered_set<ChunkCoord> nearby;
+        for (ChunkCoord coord : occupied)
+            for (int dx = -1; dx <= 1; dx++)
+                for (int dz = -1; dz <= 1; dz++)
+                    nearby.insert(ChunkCoord(coord.x + dx, coord.z + dz));
+
+        for (ChunkCoord coord : nearby)
+        {
+            if (coord.x >= 0 && coord.z >= 0 && coord.x < worldWidth && coord.z < worldWidth)
+                world.getChunk(coord);
+        }
+
+        // Bucket by chunk region so each thread works on entities that read the same few chunks
+        std::unordered_map<ChunkCoord, std::vector<uint32_t>> regions;
+        for (uint32_t i = 0; i < count(); i++)
+        {
+            int regionWidth = regionChunks * chunkWidth;
+            ChunkCoord region((int)floor(posX[i] / regionWidth), (int)floor(posZ[i] / regionWidth));
+            regions[region].push_back(i);
+        }
+
+        // The calling thread takes a batch too
+        int threadCount = std::min((int)(count() / entitiesPerThread) + 1, world.jobs.workerCount() + 1);
+        threadCount = std::min(threadCount, (int)regions.size());
+
+        if (threadCount <= 1)
+        {
+            for (auto &region : regions)
+                collide(world, region.second, dt);
+        }
+        else
+        {
+            // Deal whole regions out to batches, largest first, onto the least loaded batch
+            std::vector<std::vector<uint32_t> *> sorted;
+            for (auto &region : regions)
+                sorted.push_back(&region.second);
+            std::sort(sorted.begin(), sorted.end(), [](std::vector<uint32_t> *a, std::vector<uint32_t> *b)
+                      { return a->size() > b->size(); });
+
+            std::vector<std::vector<std::vector<uint32_t> *>> work(threadCount);
+            std::vector<size_t> load(threadCount, 0);
+            for (std::vector<uint32_t> *region : sorted)
+            {
+                int t = (int)(std::min_element(load.begin(), load.end()) - load.begin());
+                work[t].push_back(region);
+                load[t] += region->size();
+            }
+
+            // Workers and this thread claim batches until none are left
+            std::atomic<int> next{0};
+            auto claimBatches = [this, &world, &work, &next, dt]()
+            {
+                for (int t = next++; t < (int)work.size(); t = next++)
+                {
+                    for (std::vector<uint32_t> *region : work[t])
+                        collide(world, *region, dt);
+                }
+            };
+
+            std::vector<JobHandle> helpers;
+            for (int t = 1; t < threadCount; t++)
+                helpers.push_back(world.jobs.submitUrgent(claimBatches));
+
+            claimBatches();
+
+            // A helper no worker has started yet finds nothing left and returns at once
+            for (const JobHandle &helper : helpers)
+                world.jobs.runOrWait(helper);
+        }
+
+        for (size_t i = count(); i-- > 0;)
+        {
+            if (posY[i] < killHeight)
+                despawn(i);
+        }
+    }
+
+private:
+    // Gravity, water drag and speed limits. Branch-free over the arrays so it vectorises.
+    void integrate(float dt)
+    {
+        const float fallSpeed = 50.0f;
+        const float airDecay = 1.0f;
+        const float waterDecay = std::max(0.0f, 1.0f - waterDrag * dt);
+        const float groundDecay = powf(0.1f, dt);
+
+        size_t n = count();
+        float *vx = velX.data();
+        float *vy = velY.data();
+        float *vz = velZ.data();
+        const uint8_t *water = inWater.data();
+        const uint8_t *ground = grounded.data();
+
+        for (size_t i = 0; i < n; i++)
+        {
+            float w = (float)water[i];
+            float g = (float)ground[i];
+
+            vy[i] -= (gravity + (waterGravity - gravity) * w) * dt;
+
+            float decay = (airDecay + (waterDecay - airDecay) * w) * (1.0f + (groundDecay - 1.0f) * g);
+            vx[i] *= decay;
+            vz[i] *= decay;
+
+            float minY = -fallSpeed + (fallSpeed - waterSinkSpeed) * w;
+            vy[i] = std::min(std::max(vy[i], minY), fallSpeed);
+        }
+    }
+
+    void collide(World &world, const std::vector<uint32_t> &indices, float dt)
+    {
+        for (uint32_t i : indices)
+        {
+            glm::vec3 pos(posX[i], posY[i], posZ[i]);
+            glm::vec3 vel(velX[i], velY[i], velZ[i]);
+            float hw = halfWidth[i];
+
+            AABB box(pos - glm::vec3(hw, 0.0f, hw), pos + glm::vec3(hw, height[i], hw));
+            SweepResult result = sweepAABB(world, box, vel, dt, stepHeight[i], grounded[i] != 0);
+
+            posX[i] = (box.min.x + box.max.x) * 0.5f;
+            posY[i] = box.min.y;
+            posZ[i] = (box.min.z + box.max.z) * 0.5f;
+            velX[i] = vel.x;
+            velY[i] = vel.y;
+            velZ[i] = vel.z;
+            grounded[i] = result.grounded;
+
+            const BlockType &voxel = world.peekVoxel((int)round(posX[i]), (int)round(posY[i] + height[i] * 0.5f), (int)round(posZ[i]));
+            inWater[i] = voxel.isLiquid;
+        }
+    }
+};
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <chrono>
+
+enum BudgetWork
+{
+    WORK_UPLOAD,  // One chunk section copied to the GPU
+    WORK_HORIZON, // One horizon tile built and uploaded
+    WORK_REMESH,  // One edited chunk remeshed on the simulation thread
+    WORK_MESH,    // One chunk through the job pipeline, counted for throughput only
+    WORK_FREEZE,  // One cold chunk compressed
+    WORK_KINDS
+};
+
+struct WorkStats
+{
+    float averageMs = 0.1f; // Running average cost of one item
+    int doneThisFrame = 0;
+    int perSecond = 0;      // Items finished over the last full second
+    int doneThisSecond = 0;
+};
+
+// Spends a millisecond budget per frame (or tick) on queued streaming work. Before each item it checks
+// the running average cost of that kind of item against what is left, so a frame stops before the item
+// that would overrun instead of after it.
+class FrameBudget
+{
+public:
+    float budgetMs = 4.0f;
+    float spentMs = 0.0f;
+    WorkStats work[WORK_KINDS];
+
+    void begin(float budget)
+    {
+        budgetMs = budget;
+        spentMs = 0.0f;
+
+        for (WorkStats &stats : work)
+            stats.doneThisFrame = 0;
+
+        Clock::time_point now = Clock::now();
+        if (now - secondStart >= std::chrono::seconds(1))
+        {
+            for (WorkStats &stats : work)
+            {
+                stats.perSecond = stats.doneThisSecond;
+                stats.doneThisSecond = 0;
+            }
+            secondStart = now;
+        }
+    }
+
+    // The first item of each kind always runs, so nothing starves behind an estimate larger than the budget
+    bool canAfford(int kind) const
+    {
+        return work[kind].doneThisFrame == 0 || spentMs + work[kind].averageMs <= budgetMs;
+    }
+
+    // Runs fn, which returns whether it found anything to do, and folds its time into the estimate
+    template <typename Fn>
+    bool run(int kind, Fn fn)
+    {
+        Clock::time_point start = Clock::now();
+        bool did = fn();
+        float ms = std::chrono::duration<float, std::milli>(Clock::now() - start).count();
+
+        spentMs += ms;
+        if (did)
+        {
+            WorkStats &stats = work[kind];
+            stats.averageMs += (ms - stats.averageMs) * 0.1f;
+            stats.doneThisFrame++;
+            stats.doneThisSecond++;
+        }
+
+        return did;
+    }
+
+    // Work of `kind` finished elsewhere (on job workers), counted towards throughput only
+    void count(int kind, int items)
+    {
+        work[kind].doneThisSecond += items;
+    }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    Clock::time_point secondStart = Clock::now();
+};
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+
+// Rolling frame time monitor. A frame counts as a hitch when it takes more than `factor` times the median of
+// the last `window` frames, and at least minMs. After a hitch, the next cooldownFrames frames are not
+// checked, so one stall (or the capture written because of it) is only reported once.
+class HitchDetector
+{
+public:
+    float factor = 3.0f;
+    float minMs = 10.0f;
+    int window = 120;
+    int cooldownFrames = 120;
+
+    int hitches = 0;
+    float lastHitchMs = 0.0f;
+    float lastMedianMs = 0.0f;
+
+    // Returns true when this frame is a hitch
+    bool addFrame(float ms)
+    {
+        bool hitch = false;
+        if ((int)times.size() == window && cooldown == 0)
+        {
+            float median = medianMs();
+            if (ms > median * factor && ms >= minMs)
+            {
+                hitch = true;
+                hitches++;
+                lastHitchMs = ms;
+                lastMedianMs = median;
+                cooldown = cooldownFrames;
+            }
+        }
+        else if (cooldown > 0)
+        {
+            cooldown--;
+        }
+
+        // The hitch itself stays out of the window, so a run of them does not raise the median
+        if (!hitch)
+        {
+            if ((int)times.size() < window)
+                times.push_back(ms);
+            else
+                times[next] = ms;
+            next = (next + 1) % window;
+        }
+
+        return hitch;
+    }
+
+    float medianMs() const
+    {
+        if (times.empty())
+            return 0.0f;
+
+        std::vector<float> sorted = times;
+        std::nth_element(sorted.begin(), sorted.begin() + sorted.size() / 2, sorted.end());
+        return sorted[sorted.size() / 2];
+    }
+
+private:
+    std::vector<float> times; // Ring of the last `window` frame times
+    int next = 0;
+    int cooldown = 0;
+};
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <vector>
+#include <queue>
+#include <unordered_map>
+#include <unordered_set>
+#include <glm/glm.hpp>
+
+#include "voxelData.h"
+#include "chunk.h"
+#include "shader.h"
+
+// A coarse heightfield tile covering horizonTileChunks x horizonTileChunks chunks.
+// Built straight from the terrain noise, so no Chunk is ever created for it.
+struct HorizonTile
+{
+    ChunkCoord coord;
+    std::vector<float> vertices;
+    int vertexCount = 0;
+    unsigned int VAO = 0, VBO = 0;
+
+    HorizonTile(ChunkCoord coord) : coord(coord) {}
+
+    ~HorizonTile()
+    {
+        if (VAO != 0)
+        {
+            glDeleteBuffers(1, &VBO);
+            glDeleteVertexArrays(1, &VAO);
+        }
+    }
+};
+
+class Horizon
+{
+public:
+    std::unordered_map<ChunkCoord, HorizonTile *> tiles;
+    std::queue<ChunkCoord> tilesToBuild;
+    std::unordered_set<ChunkCoord> tilesInQueue;
+
+    Horizon() {}
+
+    ~Horizon()
+    {
+        for (auto &pair : tiles)
+            delete pair.second;
+    }
+
+    // Adds tiles entering the horizon radius, drops the ones leaving it and
+    // queues rebuilds for tiles whose cut-out of the chunk area changed.
+    // Cheap to call every frame: returns early when nothing moved.
+    void update(ChunkCoord centre, int rd);
+
+    // Builds the next queued tile, skipping ones dropped since they were queued. Returns false when none is left.
+    bool buildNextTile();
+
+    void render(Shader *shader, const glm::mat4 &view, const glm::mat4 &projection);
+
+    // Bytes of tile vertices kept on the CPU, and in vertex buffers
+    size_t cpuBytes() const;
+    size_t gpuBytes() const;
+
+private:
+    ChunkCoord lastCentre = ChunkCoord(-1, -1);
+    int lastRD = -1;
+    int lastScale = -1;
+    bool lastEnabled = false;
+
+    void queueTile(ChunkCoord tile);
+    bool tileOverlapsChunks(ChunkCoord tile, ChunkCoord centre, int rd);
+    bool isChunkRendered(int chunkX, int chunkZ);
+    void buildTile(HorizonTile *tile);
+};
@@ -0,0 +1,322 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <algorithm>
+#include <string>
+
+#include "profiler.h"
+
+struct Job
+{
+    std::function<void()> work;
+
+    std::mutex mutex; // Guards done and dependents
+    bool done = false;
+    std::vector<std::shared_ptr<Job>> dependents;
+
+    // Unfinished dependencies, plus one held by submit() until every dependency is wired up
+    std::atomic<int> waitingOn{1};
+
+    bool urgent = false; // Queued ahead of everything else (see JobSystem::submitUrgent)
+};
+
+typedef std::shared_ptr<Job> JobHandle;
+
+// Work-stealing scheduler. Each worker owns a deque: jobs a worker releases (the dependents of a job
+// it just finished) go on the back of its own deque and it pops from the back, so follow-up work runs
+// while its data is still in cache. Jobs submitted from outside go through a shared FIFO so they start
+// in submission order. A worker with nothing of its own takes from that FIFO, then steals from the
+// front of the other workers' deques.
+class JobSystem
+{
+public:
+    // threadCount <= 0 leaves two hardware threads for the render and simulation threads
+    JobSystem(int threadCount = 0)
+    {
+        if (threadCount <= 0)
+            threadCount = std::max(1, (int)std::thread::hardware_concurrency() - 2);
+
+        for (int i = 0; i < threadCount; i++)
+            queues.push_back(std::make_unique<WorkerQueue>());
+
+        for (int i = 0; i < threadCount; i++)
+            workers.emplace_back(&JobSystem::workerLoop, this, i);
+    }
+
+    ~JobSystem()
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            running = false;
+        }
+        wake.notify_all();
+
+        for (std::thread &worker : workers)
+            worker.join();
+    }
+
+    // Runs `work` on a worker once every job in `dependencies` has finished. Null or already
+    // finished dependencies are ignored.
+    JobHandle submit(std::function<void()> work, const std::vector<JobHandle> &dependencies = {})
+    {
+        JobHandle job = std::make_shared<Job>();
+        job->work = std::move(work);
+        unfinished++;
+
+        for (const JobHandle &dependency : dependencies)
+        {
+            if (!dependency)
+                continue;
+
+            std::lock_guard<std::mutex> lock(dependency->mutex);
+            if (!dependency->done)
+            {
+                job->waitingOn++;
+                dependency->dependents.push_back(job);
+            }
+        }
+
+        release(job);
+        return job;
+    }
+
+    // A job the caller is about to wait on, such as one batch of a tick's work. It goes to the front of
+    // the shared queue, so it does not sit behind the pipeline jobs already waiting there.
+    JobHandle submitUrgent(std::function<void()> work)
+    {
+        JobHandle job = std::make_shared<Job>();
+        job->work = std::move(work);
+        job->urgent = true;
+        unfinished++;
+
+        release(job);
+        return job;
+    }
+
+    static bool isDone(const JobHandle &job)
+    {
+        if (!job)
+            return true;
+
+        std::lock_guard<std::mutex> lock(job->mutex);
+        return job->done;
+    }
+
+    // Blocks until `job` has finished, running queued jobs on this thread in the meantime
+    void wait(const JobHandle &job)
+    {
+        while (!isDone(job))
+        {
+            if (!runOne())
+                std::this_thread::yield();
+        }
+    }
+
+    // Runs an urgent job here if no worker has taken it yet, otherwise waits for the worker running it.
+    // Unlike wait, never picks up other work, so the caller is not held up by some long pipeline job.
+    void runOrWait(const JobHandle &job)
+    {
+        int index = workerIndex();
+        WorkerQueue &queue = index >= 0 ? *queues[index] : submitted;
+
+        bool taken = false;
+        {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            auto it = std::find(queue.jobs.begin(), queue.jobs.end(), job);
+            if (it != queue.jobs.end())
+            {
+                queue.jobs.erase(it);
+                taken = true;
+            }
+        }
+
+        if (taken)
+        {
+            queued--;
+            execute(job);
+        }
+
+        waitUntilDone(job);
+    }
+
+    // Blocks until `job` has finished without running anything on this thread, for a caller that must not
+    // be held up by unrelated work (wait may pick up any queued job in the meantime)
+    static void waitUntilDone(const JobHandle &job)
+    {
+        while (!isDone(job))
+            std::this_thread::yield();
+    }
+
+    // Blocks until every submitted job, including ones still waiting on dependencies, has finished
+    void waitIdle()
+    {
+        while (unfinished > 0)
+        {
+            if (!runOne())
+                std::this_thread::yield();
+        }
+    }
+
+    // Jobs submitted and not yet finished
+    int pending() const
+    {
+        return unfinished;
+    }
+
+    int workerCount() const
+    {
+        return (int)workers.size();
+    }
+
+private:
+    struct WorkerQueue
+    {
+        std::mutex mutex;
+        std::deque<JobHandle> jobs;
+    };
+
+    std::vector<std::thread> workers;
+    std::vector<std::unique_ptr<WorkerQueue>> queues;
+    WorkerQueue submitted;
+
+    std::atomic<int> unfinished{0};
+    std::atomic<int> queued{0}; // Jobs sitting in a queue, ready to run
+
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    bool running = true;
+
+    inline static thread_local JobSystem *currentSystem = nullptr;
+    inline static thread_local int currentWorker = -1;
+
+    int workerIndex() const
+    {
+        return currentSystem == this ? currentWorker : -1;
+    }
+
+    void release(const JobHandle &job)
+    {
+        if (--job->waitingOn > 0)
+            return;
+
+        int index = workerIndex();
+        WorkerQueue &queue = index >= 0 ? *queues[index] : submitted;
+        {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (job->urgent && index < 0)
+                queue.jobs.push_front(job);
+            else
+                queue.jobs.push_back(job);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            queued++;
+        }
+        wake.notify_one();
+    }
+
+    JobHandle take()
+    {
+        int index = workerIndex();
+
+        if (index >= 0)
+        {
+            WorkerQueue &own = *queues[index];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.jobs.empty())
+            {
+                JobHandle job = std::move(own.jobs.back());
+                own.jobs.pop_back();
+                return job;
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(submitted.mutex);
+            if (!submitted.jobs.empty())
+            {
+                JobHandle job = std::move(submitted.jobs.front());
+                submitted.jobs.pop_front();
+                return job;
+            }
+        }
+
+        // Steal the oldest job from someone else, starting with the next worker along
+        int count = (int)queues.size();
+        for (int i = 1; i <= count; i++)
+        {
+            int victim = (std::max(index, 0) + i) % count;
+            if (victim == index)
+                continue;
+
+            WorkerQueue &other = *queues[victim];
+            std::lock_guard<std::mutex> lock(other.mutex);
+            if (!other.jobs.empty())
+            {
+                JobHandle job = std::move(other.jobs.front());
+                other.jobs.pop_front();
+                return job;
+            }
+        }
+
+        return nullptr;
+    }
+
+    bool runOne()
+    {
+        JobHandle job = take();
+        if (!job)
+            return false;
+
+        queued--;
+        execute(job);
+        return true;
+    }
+
+    void execute(const JobHandle &job)
+    {
+        job->work();
+        job->work = nullptr; // Drop whatever the work captured
+
+        std::vector<JobHandle> dependents;
+        {
+            std::lock_guard<std::mutex> lock(job->mutex);
+            job->done = true;
+            dependents.swap(job->dependents);
+        }
+
+        // Dependents are already counted in unfinished, so waitIdle never sees zero early
+        for (const JobHandle &dependent : dependents)
+            release(dependent);
+
+        unfinished--;
+    }
+
+    void workerLoop(int index)
+    {
+        currentSystem = this;
+        currentWorker = index;
+        PROFILE_THREAD("worker " + std::to_string(index));
+
+        while (true)
+        {
+            if (runOne())
+                continue;
+
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            wake.wait(lock, [this]()
+                      { return queued > 0 || !running; });
+
+            if (!running)
+                return;
+        }
+    }
+};
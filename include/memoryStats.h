@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+
+// Approximate heap bytes of a node-based hash container holding values of valueSize: one node per element
+// (the value, a next pointer and the cached hash) plus the bucket array
+template <typename Container>
+size_t hashContainerBytes(const Container &container, size_t valueSize)
+{
+    return container.size() * (valueSize + 2 * sizeof(void *)) + container.bucket_count() * sizeof(void *);
+}
+
+// Heap bytes one chunk holds, by what they are for
+struct ChunkMemory
+{
+    size_t object = 0;   // The Chunk and its section list
+    size_t voxels = 0;   // Expanded voxelMap, or the run-length coded blocks while cold
+    size_t edits = 0;    // Player edits kept for saving
+    size_t vertices = 0; // CPU copies of the section meshes
+
+    size_t total() const
+    {
+        return object + voxels + edits + vertices;
+    }
+
+    void add(const ChunkMemory &other)
+    {
+        object += other.object;
+        voxels += other.voxels;
+        edits += other.edits;
+        vertices += other.vertices;
+    }
+};
+
+// Live memory by subsystem (see World::measureMemory). The horizon and GPU figures are filled in on the render thread.
+struct MemoryStats
+{
+    int chunks = 0;
+    ChunkMemory chunkTotal;
+    ChunkMemory largestChunk;
+
+    size_t chunkMap = 0;      // World::chunks itself
+    size_t queues = 0;        // Generation, prefetch, relode and remesh queues and the pipeline's hand-offs
+    size_t regionPending = 0; // Saved payloads not yet written
+    size_t regionMapped = 0;  // Region files mapped for loading: address space, paged in by the OS as read
+    size_t profiler = 0;      // Event ring buffers
+    size_t horizon = 0;       // Horizon tile vertex arrays
+
+    size_t gpuChunks = 0;  // Chunk section vertex buffers
+    size_t gpuHorizon = 0; // Horizon tile vertex buffers
+
+    // Everything on the CPU side except regionMapped, which the process does not really hold
+    size_t cpuBytes() const
+    {
+        return chunkTotal.total() + chunkMap + queues + regionPending + profiler + horizon;
+    }
+
+    size_t gpuBytes() const
+    {
+        return gpuChunks + gpuHorizon;
+    }
+};
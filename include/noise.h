@@ -1,9 +1,20 @@
 #pragma once
 
+#include <cstdint>
+
 #include "FastNoiseLite.h"
 #include "voxelData.h"
 
-inline FastNoiseLite noise;
+inline FastNoiseLite createNoise()
+{
+    FastNoiseLite generator;
+    generator.SetNoiseType(FastNoiseLite::NoiseType_Perlin);
+    generator.SetFrequency(0.02f);
+    return generator;
+}
+
+// One generator per thread: every sample call sets its frequency, so sharing one would race
+inline thread_local FastNoiseLite noise = createNoise();
 
 inline float getPerlinNoise(float x, float z, float scale)
 {
@@ -21,6 +32,24 @@ inline float getPerlinNoise3D(float x, float y, float z, float scale)
     return n;
 }
 
+// Well-mixed 32 bits for a column, for generation choices that have to come out the same every time
+inline uint32_t hashColumn(int worldX, int worldZ, uint32_t salt = 0)
+{
+    uint32_t h = (uint32_t)worldX * 0x8da6b343u ^ (uint32_t)worldZ * 0xd8163841u ^ salt * 0xcb1ab31fu;
+    h ^= h >> 16;
+    h *= 0x7feb352du;
+    h ^= h >> 15;
+    h *= 0x846ca68bu;
+    h ^= h >> 16;
+    return h;
+}
+
+inline int getTerrainHeight(int worldX, int worldZ)
+{
+    float heightValue01 = getPerlinNoise(worldX, worldZ, biomeScale);
+    return heightValue01 * terrainHeight + terrainMinHeight;
+}
+
 inline float getCaveNoise(int worldX, int worldY, int worldZ)
 {
     float noise1 = getPerlinNoise3D(worldX, worldY, worldZ, caveGenLargeScale);
@@ -4,6 +4,7 @@
 
 #include "camera.h"
 #include "world.h"
+#include "collision.h"
 
 enum Gamemode
 {
@@ -13,24 +14,52 @@ enum Gamemode
     ADVENTURE
 };
 
+// Keys, mouse buttons and look direction sampled on the render thread (GLFW input is main
+// thread only) and handed to the simulation thread once per tick. Clicks latch until taken,
+// so a press shorter than a tick is not lost.
+struct InputState
+{
+    bool forward = false;
+    bool back = false;
+    bool left = false;
+    bool right = false;
+    bool jump = false;
+    bool shift = false;
+
+    bool leftMouse = false;
+    bool rightMouse = false;
+    bool leftClick = false;
+    bool rightClick = false;
+
+    glm::vec3 lookForward = glm::vec3(0.0f, 0.0f, 1.0f);
+    glm::vec3 lookRight = glm::vec3(1.0f, 0.0f, 0.0f);
+};
+
 class Player
 {
 public:
-    Camera *camera;
+    Camera *camera; // Render thread only
+
 
     glm::vec3 velocity;
     glm::vec3 position;
+    glm::vec3 previousPosition; // Position at the start of the last tick, for render interpolation
 
     bool isGrounded = false;
+    bool isSprinting = false;
+
+    // Look direction from the last InputState, used by the simulation instead of the camera
+    glm::vec3 lookForward = glm::vec3(0.0f, 0.0f, 1.0f);
+    glm::vec3 lookRight = glm::vec3(1.0f, 0.0f, 0.0f);
 
     Gamemode gamemode;
 
     float reach = 5.0f;
-    float stepIncrement = 0.01f;
 
-    bool mouseDown = false;
+    // Block under the crosshair, found once per tick by updateTarget
+    RaycastHit target;
+
     bool click = false;
-    bool rightMouseDown = false;
     bool rightClick = false;
 
     bool jump = false;
@@ -45,6 +74,7 @@ public:
         this->gamemode = gamemode;
 
         position = glm::vec3(worldWidth / 2.0f * chunkWidth, 200.0f, worldWidth / 2.0f * chunkWidth);
+        previousPosition = position;
         velocity = glm::vec3(0.0f);
 
         coord = ChunkCoord(floor(worldWidth/2), floor(worldWidth/2));
@@ -61,70 +91,43 @@ public:
         coord = world->getChunkCoordFromVec3(position);
     }
 
-    glm::vec3 getViewBlock()
+    void updateTarget()
     {
-        glm::vec3 rayPos = camera->pos;
-        glm::vec3 prevPos = rayPos;
-        glm::vec3 rayDir = glm::normalize(camera->forward) * stepIncrement;
-
-        while (glm::distance(camera->pos, rayPos) < reach)
-        {
-            int x = round(rayPos.x);
-            int y = round(rayPos.y);
-            int z = round(rayPos.z);
-
-            if (world->checkForVoxel(x, y, z))
-            {
-                return glm::vec3(x, y, z);
-            }
+        target = world->raycast(getEyePosition(), lookForward, reach);
+    }
 
-            prevPos = rayPos;
-            rayPos += rayDir;
-        }
+    glm::vec3 getViewBlock()
+    {
+        if (!target.hit)
+            return glm::vec3(0.0f, -1000.0f, 0.0f);
 
-        return glm::vec3(0.0f, -1000.0f, 0.0f);
+        return glm::vec3(target.block);
     }
 
     void checkBlock()
     {
-        glm::vec3 rayPos = camera->pos;
-        glm::vec3 prevPos = rayPos;
-        glm::vec3 rayDir = glm::normalize(camera->forward) * stepIncrement;
+        if (!target.hit)
+            return;
 
-        while(glm::distance(camera->pos, rayPos) < reach)
+        if (click)
+        {
+            world->setVoxel(target.block.x, target.block.y, target.block.z, 0); // Air
+            updateTarget();
+        }
+        else if (rightClick)
         {
-            int x = round(rayPos.x);
-            int y = round(rayPos.y);
-            int z = round(rayPos.z);
+            glm::ivec3 place = target.place;
 
-            if (world->checkForVoxel(x, y, z))
+            if (!world->checkForVoxel(place.x, place.y, place.z))
             {
-                if (click)
-                {
-                    world->setVoxel(x, y, z, 0); // Air
-                    break;
-                }
-                else if (rightClick)
+                glm::vec3 blockPos = glm::vec3(place);
+
+                if (!isPlayerInBlock(blockPos))
                 {
-                    int placeX = round(prevPos.x);
-                    int placeY = round(prevPos.y);
-                    int placeZ = round(prevPos.z);
-
-                    if (!world->checkForVoxel(placeX, placeY, placeZ))
-                    {
-                        glm::vec3 blockPos = glm::vec3(placeX, placeY, placeZ);
-
-                        if (!isPlayerInBlock(blockPos))
-                        {
-                            world->setVoxel(placeX, placeY, placeZ, 3); // Stone
-                        }
-                    }
-                    break;
+                    world->setVoxel(place.x, place.y, place.z, 3); // Stone
+                    updateTarget();
                 }
             }
-
-            prevPos = rayPos;
-            rayPos += rayDir;
         }
     }
 
@@ -139,34 +142,41 @@ public:
         return false;
     }
 
-    void processInput(GLFWwindow *window, float dt)
+    void processInput(const InputState &input, float dt)
     {
-        if (gamemode == SPECTATOR) processSpectatorMovement(window, dt);
-        else processNormalMovement(window, dt);
-
-        if(click) click = false;
-        if(rightClick) rightClick = false;
+        lookForward = input.lookForward;
+        lookRight = input.lookRight;
 
-        if(glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS)
-        {
-            if(!mouseDown) click = true;
-            mouseDown = true;
-        } else mouseDown = false;
+        if (gamemode == SPECTATOR) processSpectatorMovement(input, dt);
+        else processNormalMovement(input, dt);
 
-        if (glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_RIGHT) == GLFW_PRESS)
-        {
-            if (!rightMouseDown) rightClick = true;
-            rightMouseDown = true;
-        } else rightMouseDown = false;
+        click = input.leftClick;
+        rightClick = input.rightClick;
 
-        jump = glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS;
+        jump = input.jump;
+    }
 
+    // Render thread: mouse look runs every rendered frame rather than every tick
+    void processLook(GLFWwindow *window, float dt)
+    {
         camera->processInput(window, dt);
-        camera->setPos(position + glm::vec3(0.0f, playerHeight*0.9f, 0.0f));
+    }
+
+    // Render thread: places the camera between two tick positions taken from a snapshot
+    void placeCamera(glm::vec3 previous, glm::vec3 current, float alpha)
+    {
+        camera->setPos(glm::mix(previous, current, alpha) + glm::vec3(0.0f, playerHeight * 0.9f, 0.0f));
+    }
+
+    glm::vec3 getEyePosition()
+    {
+        return position + glm::vec3(0.0f, playerHeight * 0.9f, 0.0f);
     }
 
     void updatePhysics(float dt)
     {
+        previousPosition = position;
+
         // Skip physics in spectator mode
         if (gamemode == SPECTATOR)
         {
@@ -199,7 +209,6 @@ public:
         }
 
         moveWithCollision(dt);
-        camera->setPos(position + glm::vec3(0.0f, playerHeight * 0.9f, 0.0f));
     }
 
     bool isHeadInWater()
@@ -215,6 +224,7 @@ private:
 
     float playerHeight = 1.8f;
     float playerWidth = 0.6f;
+    float stepHeight = 0.6f;
 
     float spectatorSpeed = 50.0f;
     float spectatorAirResistance = 0.98f;
@@ -223,7 +233,6 @@ private:
     float sprintSpeed = 6.5f;
     float friction = 0.1f;
 
-    bool isSprinting = false;
     bool inWater = false;
     bool fly = false;
 
@@ -235,21 +244,21 @@ private:
     float maxFallSpeed = 50.0f;
     float maxMovementSpeed = 8.0f;
 
-    void processSpectatorMovement(GLFWwindow *window, float dt)
+    void processSpectatorMovement(const InputState &input, float dt)
     {
         glm::vec3 inputDir = glm::vec3(0.0f);
 
-        if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
-            inputDir += camera->forward;
-        if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
-            inputDir -= camera->forward;
-        if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
-            inputDir -= camera->right;
-        if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
-            inputDir += camera->right;
+        if (input.forward)
+            inputDir += lookForward;
+        if (input.back)
+            inputDir -= lookForward;
+        if (input.left)
+            inputDir -= lookRight;
+        if (input.right)
+            inputDir += lookRight;
         if (jump)
             inputDir += glm::vec3(0.0f, 1.0f, 0.0f);
-        if (glfwGetKey(window, GLFW_KEY_LEFT_SHIFT) == GLFW_PRESS)
+        if (input.shift)
             inputDir -= glm::vec3(0.0f, 1.0f, 0.0f);
 
         if (glm::length(inputDir) > 0.0f)
@@ -258,33 +267,31 @@ private:
         velocity += inputDir * spectatorSpeed * dt;
     }
 
-    void processNormalMovement(GLFWwindow *window, float dt)
+    void processNormalMovement(const InputState &input, float dt)
     {
         glm::vec3 inputDir = glm::vec3(0.0f);
 
-        glm::vec3 forward = glm::normalize(glm::vec3(camera->forward.x, 0.0f, camera->forward.z));
-        glm::vec3 right = glm::normalize(glm::vec3(camera->right.x, 0.0f, camera->right.z));
+        glm::vec3 forward = glm::normalize(glm::vec3(lookForward.x, 0.0f, lookForward.z));
+        glm::vec3 right = glm::normalize(glm::vec3(lookRight.x, 0.0f, lookRight.z));
 
-        if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
+        if (input.forward)
             inputDir += forward;
-        if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
+        if (input.back)
             inputDir -= forward;
-        if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
+        if (input.left)
             inputDir -= right;
-        if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
+        if (input.right)
             inputDir += right;
 
         if (glm::length(inputDir) > 0.0f)
             inputDir = glm::normalize(inputDir);
 
-        isSprinting = glfwGetKey(window, GLFW_KEY_LEFT_SHIFT) == GLFW_PRESS;
-        fly = glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS;
+        isSprinting = input.shift;
+        fly = input.jump;
 
         float targetSpeed = isSprinting? sprintSpeed : speed;
         if (inWater) targetSpeed *= waterDrag;
 
-        camera->updateFOV(isSprinting);
-
         glm::vec3 targetVelocity = inputDir * targetSpeed;
 
         float accel = isGrounded ? groundAcceleration : inWater ? airAcceleration * 0.8f : airAcceleration;
@@ -302,7 +309,7 @@ private:
                 velocity.z = 0;
         }
 
-        if (glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS)
+        if (input.jump)
         {
             if (jump && isGrounded && !inWater)
             {
@@ -318,48 +325,13 @@ private:
 
     void moveWithCollision(float dt)
     {
-        isGrounded = false;
-
-        // Move X axis
-        glm::vec3 newPos = position;
-        newPos.x += velocity.x * dt;
-        if (!checkCollision(newPos))
-        {
-            position.x = newPos.x;
-        }
-        else
-        {
-            velocity.x = 0;
-        }
-
-        // Move Z axis
-        newPos = position;
-        newPos.z += velocity.z * dt;
-        if (!checkCollision(newPos))
-        {
-            position.z = newPos.z;
-        }
-        else
-        {
-            velocity.z = 0;
-        }
+        float halfWidth = playerWidth / 2.0f;
+        AABB box(position - glm::vec3(halfWidth, 0.0f, halfWidth), position + glm::vec3(halfWidth, playerHeight, halfWidth));
 
-        // Move Y axis last (vertical)
-        newPos = position;
-        newPos.y += velocity.y * dt;
+        SweepResult result = sweepAABB(*world, box, velocity, dt, stepHeight, isGrounded);
 
-        if (!checkCollision(newPos))
-        {
-            position.y = newPos.y;
-        }
-        else
-        {
-            if (velocity.y < 0) // Falling down
-            {
-                isGrounded = true;
-            }
-            velocity.y = 0;
-        }
+        position = glm::vec3((box.min.x + box.max.x) * 0.5f, box.min.y, (box.min.z + box.max.z) * 0.5f);
+        isGrounded = result.grounded;
     }
 
     bool isPlayerInBlock(glm::vec3 blockPos)
@@ -434,40 +406,4 @@ private:
 
         return false;
     }
-
-    bool checkCollision(glm::vec3 pos)
-    {
-        float halfWidth = playerWidth / 2.0f;
-
-        // Check corners of player bounding box
-        glm::vec3 checkPoints[] = {
-            // Bottom corners
-            pos + glm::vec3(-halfWidth, 0.0f, -halfWidth),
-            pos + glm::vec3(halfWidth, 0.0f, -halfWidth),
-            pos + glm::vec3(-halfWidth, 0.0f, halfWidth),
-            pos + glm::vec3(halfWidth, 0.0f, halfWidth),
-
-            // Top corners
-            pos + glm::vec3(-halfWidth, playerHeight, -halfWidth),
-            pos + glm::vec3(halfWidth, playerHeight, -halfWidth),
-            pos + glm::vec3(-halfWidth, playerHeight, halfWidth),
-            pos + glm::vec3(halfWidth, playerHeight, halfWidth),
-
-            // Middle corners
-            pos + glm::vec3(-halfWidth, playerHeight * 0.5f, -halfWidth),
-            pos + glm::vec3(halfWidth, playerHeight * 0.5f, -halfWidth),
-            pos + glm::vec3(-halfWidth, playerHeight * 0.5f, halfWidth),
-            pos + glm::vec3(halfWidth, playerHeight * 0.5f, halfWidth),
-        };
-
-        for (const auto &point : checkPoints)
-        {
-            if (world->isVoxelSolid(round(point.x), round(point.y), round(point.z)))
-            {
-                return true;
-            }
-        }
-
-        return false;
-    }
 };
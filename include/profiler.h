@@ -0,0 +1,187 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <cstdint>
+
+// One finished scope
+struct ProfileEvent
+{
+    const char *name = nullptr; // A string literal, so it outlives the event
+    int64_t start = 0;          // Nanoseconds on Profiler::now()'s clock
+    int64_t end = 0;
+    int depth = 0; // Scopes already open on the thread when it started
+};
+
+// The last eventCapacity scopes one thread finished. Only that thread writes; the lock is for the
+// render thread reading them out, so it is never contended between writers.
+struct ProfileThread
+{
+    std::string name;
+    int id = 0;
+
+    std::mutex mutex;
+    std::vector<ProfileEvent> events; // Ring, event i at i % eventCapacity
+    uint64_t written = 0;
+
+    int depth = 0;     // Owning thread only
+    uint64_t read = 0; // Render thread only: events already folded into the stats
+};
+
+// An event with the thread it ran on, as it goes into a trace
+struct TraceEvent
+{
+    ProfileEvent event;
+    int thread = 0; // ProfileThread::id
+};
+
+// One render frame: how long it took and the top-level scopes the render thread ran in it
+struct ProfileFrame
+{
+    int64_t start = 0;
+    int64_t end = 0;
+    std::vector<std::pair<const char *, float>> stages; // Milliseconds, in the order they ran
+
+    float ms() const
+    {
+        return (end - start) / 1e6f;
+    }
+};
+
+// Running figures for one scope name, over every thread
+struct ScopeStats
+{
+    const char *name = nullptr;
+    int calls = 0;         // In the last frame
+    float lastMs = 0.0f;   // Total in the last frame
+    float frameMs = 0.0f;  // Rolling average total per frame
+    float callMs = 0.0f;   // Rolling average per call
+    float worstMs = 0.0f;  // Longest single call since resetWorst
+};
+
+// Scoped timers with a ring buffer per thread, cheap enough to leave in hot paths. Events are only
+// collected while enabled. The render thread calls markFrame once a frame, which folds the events
+// every thread finished since into the frame history and the per-scope stats the profiler panel shows.
+class Profiler
+{
+public:
+    static constexpr int eventCapacity = 1 << 15;
+    static constexpr int frameCapacity = 240;
+
+    std::atomic<bool> enabled{true};
+
+    static int64_t now();
+
+    // Names the calling thread in the panel (and in exported traces)
+    void setThreadName(const std::string &name);
+
+    // The calling thread's buffer, created on first use
+    ProfileThread &thread();
+
+    void record(ProfileThread &thread, const ProfileEvent &event);
+
+    // Render thread, once per frame. Returns the frame it closed.
+    const ProfileFrame &markFrame();
+
+    // Render thread only: frames from oldest to newest, and scopes in the order first seen
+    std::vector<const ProfileFrame *> frameHistory() const;
+    const std::vector<ScopeStats> &scopeStats() const
+    {
+        return scopes;
+    }
+
+    void resetWorst();
+
+    // Heap held by the ring buffers
+    size_t memoryBytes();
+
+    // Records every event for `seconds`, then writes them, with a "frame" event per render frame, to path as
+    // Chrome trace JSON (chrome://tracing or ui.perfetto.dev). Written on a thread of its own.
+    void startCapture(float seconds, const std::string &path);
+
+    // Render thread only
+    bool capturing() const
+    {
+        return captureEnd != 0;
+    }
+    float captureSecondsLeft() const;
+    std::string lastCapture; // Path and event count of the last trace written
+
+    // Writes events as Chrome trace JSON, timed from `origin`. `metadata`, when given, is a JSON object
+    // added to the file under "metadata".
+    void writeTrace(const std::string &path, const std::vector<TraceEvent> &events, int64_t origin, const std::string &metadata = "");
+
+    // writeTrace on the trace writer thread. Render thread only.
+    void writeTraceLater(const std::string &path, std::vector<TraceEvent> events, int64_t origin, const std::string &metadata = "");
+
+    // Render thread only: every event still in the ring buffers that ended at or after `since`, plus a
+    // "frame" event for each frame in the history
+    void recentEvents(int64_t since, std::vector<TraceEvent> &out);
+
+    ~Profiler();
+
+private:
+    std::mutex threadsMutex;
+    std::vector<std::unique_ptr<ProfileThread>> threads;
+
+    // Render thread only
+    std::vector<ProfileFrame> frames; // Ring of frameCapacity
+    int framesDone = 0;
+    int64_t frameStart = 0;
+    std::vector<ScopeStats> scopes;
+
+    // Render thread only
+    int64_t captureStart = 0;
+    int64_t captureEnd = 0; // 0 when not capturing
+    std::string capturePath;
+    std::vector<TraceEvent> captured;
+    std::thread traceWriter;
+
+    ScopeStats &scope(const char *name);
+    void finishCapture();
+};
+
+extern Profiler profiler;
+
+class ProfileScope
+{
+public:
+    ProfileScope(const char *name) : name(name)
+    {
+        if (!profiler.enabled)
+            return;
+
+        owner = &profiler.thread();
+        depth = owner->depth++;
+        start = Profiler::now();
+    }
+
+    ~ProfileScope()
+    {
+        if (owner == nullptr)
+            return;
+
+        owner->depth--;
+        profiler.record(*owner, {name, start, Profiler::now(), depth});
+    }
+
+    ProfileScope(const ProfileScope &) = delete;
+    ProfileScope &operator=(const ProfileScope &) = delete;
+
+private:
+    const char *name;
+    ProfileThread *owner = nullptr;
+    int64_t start = 0;
+    int depth = 0;
+};
+
+#define PROFILE_JOIN_(a, b) a##b
+#define PROFILE_JOIN(a, b) PROFILE_JOIN_(a, b)
+
+// Times the rest of the enclosing block under `name`, which must be a string literal
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_JOIN(profileScope, __LINE__)(name)
+#define PROFILE_THREAD(name) profiler.setThreadName(name)
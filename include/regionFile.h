@@ -0,0 +1,93 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstdint>
+
+#include "chunk.h"
+
+// Saved chunks, in region files of regionSize x regionSize chunks ("r.<x>.<z>.region" in one directory).
+// A region file is a header, a table saying where each chunk's payload sits, then the payloads, which
+// the store does not look inside (see Chunk::readPayload).
+// Loads read a memory map of the file and may come from any thread. Saves are queued and written by the
+// store's own writer thread, so saving never stalls the simulation.
+class RegionStore
+{
+public:
+    static const int regionSize = 32;
+
+    std::atomic<int> chunksLoaded{0};
+    std::atomic<int> chunksWritten{0};
+    std::atomic<long long> bytesWritten{0}; // Payload bytes
+    std::atomic<int> writeFailures{0}; // Chunks whose write failed and was queued again
+
+    RegionStore(const std::string &directory);
+    ~RegionStore(); // Finishes the queued writes
+
+    // Payload last saved for coord. Returns false if coord was never saved.
+    bool load(ChunkCoord coord, std::vector<uint8_t> &payload);
+
+    // Queues a payload to be written. load sees it straight away.
+    void save(ChunkCoord coord, std::vector<uint8_t> payload);
+
+    // Blocks until every queued save is on disk, or the writer has failed to write what is left
+    void flush();
+
+    int pendingWrites();
+
+    // Payload bytes waiting to be written, and bytes of region file currently mapped for loading
+    size_t pendingBytes();
+    size_t mappedBytes();
+
+private:
+    struct Entry
+    {
+        uint32_t offset = 0; // 0 when the chunk has no payload
+        uint32_t size = 0;
+        uint32_t capacity = 0; // Bytes reserved; a rewrite that fits goes in place
+    };
+
+    struct Region
+    {
+        std::string path;
+        std::shared_mutex lock; // Shared while loading, exclusive while the writer rewrites the file
+
+        // Read-only view of the whole file
+        const uint8_t *data = nullptr;
+        size_t size = 0;
+        std::vector<uint8_t> copy; // Backs data where there is no mmap
+    };
+
+    typedef std::shared_ptr<const std::vector<uint8_t>> Payload;
+
+    std::string directory;
+
+    std::mutex regionsMutex;
+    std::unordered_map<ChunkCoord, std::unique_ptr<Region>> regions; // Keyed by region coordinate
+
+    // Saved but not yet written, so load can still find them
+    std::mutex pendingMutex;
+    std::condition_variable pendingChanged;
+    std::unordered_map<ChunkCoord, Payload> pending;
+    bool writing = false;
+    bool failing = false; // The last write failed; the writer tries again after a delay
+    bool running = true;
+
+    std::thread writer;
+
+    Region &getRegion(ChunkCoord regionCoord);
+    void map(Region &region);
+    void unmap(Region &region);
+    bool writeRegion(Region &region, std::vector<std::pair<ChunkCoord, Payload>> &chunks);
+    void writerLoop();
+
+    static ChunkCoord regionOf(ChunkCoord coord);
+    static int indexInRegion(ChunkCoord coord);
+};
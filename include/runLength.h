@@ -0,0 +1,64 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Byte run-length coding: each run is its length as a varint (7 bits per byte, low bits first)
+// followed by the repeated byte. Chunk::getBlocks lays blocks out a column at a time, so a column
+// of stone, dirt, grass and air comes out as four runs.
+
+inline void encodeRuns(const uint8_t *data, size_t count, std::vector<uint8_t> &out)
+{
+    size_t i = 0;
+    while (i < count)
+    {
+        uint8_t value = data[i];
+        size_t run = 1;
+        while (i + run < count && data[i + run] == value)
+            run++;
+
+        size_t length = run;
+        while (length >= 0x80)
+        {
+            out.push_back((uint8_t)(length | 0x80));
+            length >>= 7;
+        }
+        out.push_back((uint8_t)length);
+        out.push_back(value);
+
+        i += run;
+    }
+}
+
+// Returns false if the runs are malformed or do not add up to exactly `count` bytes
+inline bool decodeRuns(const uint8_t *in, size_t size, uint8_t *out, size_t count)
+{
+    size_t read = 0, written = 0;
+    while (read < size)
+    {
+        size_t length = 0;
+        int shift = 0;
+        while (true)
+        {
+            if (read >= size || shift > 28)
+                return false;
+
+            uint8_t byte = in[read++];
+            length |= (size_t)(byte & 0x7F) << shift;
+            shift += 7;
+
+            if ((byte & 0x80) == 0)
+                break;
+        }
+
+        if (read >= size || length > count - written)
+            return false;
+
+        uint8_t value = in[read++];
+        for (size_t i = 0; i < length; i++)
+            out[written++] = value;
+    }
+
+    return written == count;
+}
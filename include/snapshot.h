@@ -0,0 +1,86 @@
+#pragma once
+
+#include <vector>
+#include <mutex>
+#include <glm/glm.hpp>
+
+#include "chunk.h"
+#include "world.h"
+#include "player.h"
+#include "frameBudget.h"
+
+// Everything the render thread needs from one simulation tick. The render thread never touches
+// World or Player state directly; it draws from the latest snapshot instead.
+struct RenderSnapshot
+{
+    std::vector<Chunk *> visibleChunks;
+    std::vector<Chunk *> retiredChunks; // Removed from the world, to be deleted by the render thread
+
+    ChunkCoord playerCoord;
+    glm::vec3 previousPosition = glm::vec3(0.0f);
+    glm::vec3 position = glm::vec3(0.0f);
+    Gamemode gamemode = SURVIVAL;
+    bool sprinting = false;
+    bool headInWater = false;
+    RaycastHit target;
+
+    std::vector<glm::vec3> entityPrevious;
+    std::vector<glm::vec3> entityPositions;
+    std::vector<glm::vec2> entitySizes; // Width, height
+
+    int renderDistance = 0;
+    size_t chunksLoaded = 0;
+    size_t chunksQueued = 0;
+    size_t chunksPrefetchQueued = 0;
+    int jobsPending = 0;
+    float jobMs = 0.0f;
+    FrameBudget tickBudget; // Remeshing on the simulation thread, and pipeline throughput
+    PrefetchStats prefetch;
+    ColdStats cold;
+    int regionLoads = 0;
+    int regionWrites = 0;
+    int regionPending = 0;
+    long long regionBytes = 0;
+    MemoryStats memory; // CPU side only; the render thread adds the horizon and GPU figures
+
+    double tickTime = 0.0; // glfwGetTime() when the tick finished, for interpolation
+    float tickMs = 0.0f;
+    int ticks = 0;
+};
+
+// Double buffer between the threads: the simulation thread fills its own snapshot and swaps it
+// in with publish(); the render thread swaps the newest one out with acquire(). Only the swaps
+// are locked, so neither thread waits on the other's work.
+class SnapshotBuffer
+{
+public:
+    void publish(RenderSnapshot &filled)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        // The render thread skipped the pending snapshot; keep its retired chunks so they still get freed
+        if (fresh)
+            filled.retiredChunks.insert(filled.retiredChunks.end(), pending.retiredChunks.begin(), pending.retiredChunks.end());
+
+        std::swap(pending, filled);
+        fresh = true;
+    }
+
+    // Returns false, leaving `front` untouched, when nothing new was published
+    bool acquire(RenderSnapshot &front)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        if (!fresh)
+            return false;
+
+        std::swap(pending, front);
+        fresh = false;
+        return true;
+    }
+
+private:
+    std::mutex mutex;
+    RenderSnapshot pending;
+    bool fresh = false;
+};
@@ -6,13 +6,14 @@
 extern int worldWidth;
 extern int chunkWidth;
 extern int chunkHeight;
+extern int sectionHeight;
 
 extern float biomeScale;
 extern int terrainMinHeight;
 extern int terrainHeight;
 
-static int waterHeight = 64;
-static int sandHeight = 60;
+const int waterHeight = 64;
+const int sandHeight = 60;
 
 extern float caveGenLargeScale;
 extern float caveGenMediumScale;
@@ -34,13 +35,26 @@ extern int treeMaxHeight;
 
 extern bool useRD;
 extern int renderDistance;
+extern int keepAliveDistance;
+extern float coldChunkSeconds;
 
-static float gravity = 10.0f;
-static float waterGravity = 3.5f;
-static float waterDrag = 0.5f;
-static float waterFloat = 4.0f;
-static float waterSinkSpeed = 1.0f;
+extern const char *saveDirectory;
+
+extern bool useHorizon;
+extern int horizonScale;
+extern int horizonStep;
+extern int horizonTileChunks;
+
+extern int targetFPS;
+extern float frameBudgetShare;
+
+const float gravity = 10.0f;
+const float waterGravity = 3.5f;
+const float waterDrag = 0.5f;
+const float waterFloat = 4.0f;
+const float waterSinkSpeed = 1.0f;
 
 extern float cubeVertices[48*6];
 extern int faceChecks[6][3];
 extern BlockType blockTypes[];
+extern int blockTypeCount;
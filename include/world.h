@@ -1,110 +1,636 @@
 #pragma once
 
 #include <vector>
-#include <queue>
+#include <algorithm>
 #include <unordered_map>
 #include <unordered_set>
+#include <limits>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <memory>
 #include <glm/glm.hpp>
 
 #include "noise.h"
 
 #include "voxelData.h"
 #include "chunk.h"
+#include "jobs.h"
+#include "chunkQueue.h"
+#include "frameBudget.h"
+#include "regionFile.h"
+#include "profiler.h"
+
+// A copied box of voxels, laid out like Chunk::voxelMap ([x][y][z], z fastest)
+struct RegionBuffer
+{
+    glm::ivec3 size = glm::ivec3(0);
+    std::vector<BlockType> blocks;
+
+    BlockType &at(int x, int y, int z)
+    {
+        return blocks[(x * size.y + y) * size.z + z];
+    }
+};
+
+// A chunk and its eight neighbours, captured on the simulation thread for a pipeline job so the job
+// never has to look anything up in World::chunks. Missing chunks (past the world edge) are nullptr.
+struct ChunkArea
+{
+    ChunkCoord centre;
+    Chunk *chunks[3][3] = {};
+
+    Chunk *at(int dx, int dz) const
+    {
+        return chunks[dx + 1][dz + 1];
+    }
+
+    bool allAtStage(int stage) const
+    {
+        for (int i = 0; i < 3; i++)
+            for (int j = 0; j < 3; j++)
+                if (chunks[i][j] != nullptr && chunks[i][j]->stage < stage)
+                    return false;
+        return true;
+    }
+};
+
+// What a re-run of the ore stage (World::setLode) says each voxel of one chunk between heights band.x
+// and band.y should now be. 0 where the voxel is not terrain stone, which the ore stage leaves alone.
+struct LodeResult
+{
+    Chunk *chunk = nullptr;
+    ChunkCoord coord;
+    int version = 0;
+    glm::ivec2 band = glm::ivec2(0);
+    std::vector<uint8_t> blocks; // [x][y - band.x][z]
+};
+
+// Ready chunks by whether their voxels are expanded or compressed (see World::freezeColdChunks)
+struct ColdStats
+{
+    int hot = 0;
+    int cold = 0;
+    size_t bytesSaved = 0;
+};
+
+// Whether chunks were already meshed when they came into render distance
+struct PrefetchStats
+{
+    int entered = 0;
+    int ready = 0;
+    int prefetched = 0;      // Entered chunks that the prefetcher had requested
+    int prefetchedReady = 0;
+};
+
+struct RaycastHit
+{
+    bool hit = false;
+    glm::ivec3 block = glm::ivec3(0);  // Voxel the ray stopped in
+    glm::ivec3 normal = glm::ivec3(0); // Face of that voxel the ray entered through
+    glm::ivec3 place = glm::ivec3(0);  // Empty cell in front of that face, where a block would be placed
+    float distance = 0.0f;
+};
 
 class World
 {
 public:
     std::unordered_map<ChunkCoord, Chunk *> chunks;
-    std::queue<ChunkCoord> chunksToGenerate;
-    std::unordered_set<ChunkCoord> chunksInQueue;
+    ChunkQueue chunksToGenerate;
+    std::unordered_map<ChunkCoord, uint32_t> dirtySections;
+
+    // Runs the chunk pipeline (generate, decorate, mesh) off the simulation thread
+    JobSystem jobs;
+    std::atomic<float> averageJobMs{1.0f}; // Running average cost of a pipeline job, sizes the submit window
+    std::atomic<int> chunksMeshed{0};      // Meshed by the pipeline since the simulation last took the count
+
+    // Chunks expected to come into range soon, drained only once chunksToGenerate is empty
+    ChunkQueue chunksToPrefetch;
+    float prefetchSeconds = 2.0f; // How far ahead the player's path is extrapolated
+    float prefetchMinSpeed = 5.0f; // Blocks per second; slower than this the ring update keeps up
+    PrefetchStats prefetchStats;
+
+    // Lode settings the generate jobs use. setLode swaps in a new set, so a running job keeps the one it
+    // was submitted with.
+    std::shared_ptr<const std::vector<Lode>> lodeSet;
+    std::atomic<int> lodeVersion{0}; // Bumped by every setLode
+    ChunkQueue chunksToRelode;       // Ready chunks whose ore stage predates lodeVersion
+
+    double accessTime = 0.0; // Stamped on chunks by getChunk; set by freezeColdChunks
+    ColdStats coldStats;
+
+    // Where the edits of unloaded chunks are saved and loaded back from. Without one, edits are lost on unload.
+    std::unique_ptr<RegionStore> regions;
+
+    // Chunks removed from the world. The render thread may still be drawing them, so they are
+    // handed over in the next RenderSnapshot and deleted there along with their GPU buffers.
+    std::vector<Chunk *> retiredChunks;
 
-    World()
+    // workers 0 leaves two cores free for the render and simulation threads
+    World(int workers = 0) : jobs(workers), lodeSet(std::make_shared<const std::vector<Lode>>(lodes, lodes + lodeCount)) {}
+
+    void retireChunk(Chunk *chunk)
+    {
+        if (chunk != nullptr)
+            retiredChunks.push_back(chunk);
+    }
+
+    void updateRenderDistance(ChunkCoord centre)
+    {
+        PROFILE_SCOPE("updateRenderDistance");
+
+        // Queue the chunks that came into mesh range since the last call: after a one chunk move that is
+        // one row or column, after a render distance change the annulus between the two. submitQueuedChunks
+        // hands them to the job system in priority order, which generates the ring around them as dependencies.
+        auto enter = [&](ChunkCoord coord)
+        {
+            if (rangeRD >= 0)
+                recordEntry(coord);
+
+            if (!isMeshPending(coord))
+                chunksToGenerate.push(coord);
+        };
+
+        if (rangeRD < 0)
+            forEachInSquare(centre, renderDistance, enter);
+        else
+            forEachInSquareDifference(centre, renderDistance, rangeCentre, rangeRD, enter);
+
+        rangeCentre = centre;
+        rangeRD = renderDistance;
+    }
+
+    // Keeps about lookaheadMs of pipeline work per worker in flight, going by the measured cost of a job,
+    // so workers never run dry between calls while the queue rather than the job system decides what is
+    // generated next
+    void submitQueuedChunks(float lookaheadMs)
     {
-        noise.SetNoiseType(FastNoiseLite::NoiseType_Perlin);
-        noise.SetFrequency(0.02f);
+        PROFILE_SCOPE("submitQueuedChunks");
+
+        requeueRetries();
+        rerunLodes();
+        applyDeferredEdits();
+
+        int perWorker = std::max(2, (int)ceil(lookaheadMs / std::max(averageJobMs.load(), 0.01f)));
+        int maxPending = jobs.workerCount() * perWorker;
+
+        while (!chunksToGenerate.empty() && jobs.pending() < maxPending)
+            requestMesh(chunksToGenerate.pop());
+
+        while (!chunksToPrefetch.empty() && jobs.pending() < maxPending)
+        {
+            ChunkCoord coord = chunksToPrefetch.pop();
+            prefetched.insert(coord);
+            requestMesh(coord);
+        }
     }
 
-    void updateRenderDistance(ChunkCoord centre, bool regenAll = false)
+    // Extrapolates the player's path over the next prefetchSeconds, leaning a little towards where the
+    // camera looks, and queues the chunks that will come into render distance along it. Only redone
+    // when the predicted end point moves to another chunk.
+    void prefetch(ChunkCoord centre, glm::vec3 position, glm::vec3 velocity, glm::vec3 forward)
     {
-        int maxDist = renderDistance + 1;
+        PROFILE_SCOPE("prefetch");
+
+        glm::vec2 flatVelocity(velocity.x, velocity.z);
+        float speed = glm::length(flatVelocity);
+
+        ChunkCoord lead = centre;
+        glm::vec2 direction(0.0f);
+        if (speed >= prefetchMinSpeed)
+        {
+            direction = flatVelocity / speed;
+
+            glm::vec2 look(forward.x, forward.z);
+            if (glm::length(look) > 0.0f)
+                direction = glm::normalize(direction * 0.75f + glm::normalize(look) * 0.25f);
+
+            lead = predictChunk(position, direction, speed * prefetchSeconds);
+        }
+
+        if (lead == prefetchLead && centre == prefetchCentre)
+            return;
+
+        ChunkCoord oldLead = prefetchLead;
+        prefetchLead = lead;
+        prefetchCentre = centre;
+        chunksToPrefetch.clear();
+
+        // Work requested around the old end of the path may not be wanted any more
+        forEachInSquareDifference(oldLead, renderDistance + 2, lead, renderDistance + 2, [&](ChunkCoord coord)
+                                  { cancelIfUnwanted(coord, centre); });
+
+        if (lead == centre)
+            return;
+
+        chunksToPrefetch.setFocus(centre, glm::vec3(direction.x, 0.0f, direction.y));
 
-        for (int d = 0; d < maxDist; d++)
+        // Sample the path about once per chunk travelled
+        int steps = std::max(1, chunkDistance(lead, centre));
+        ChunkCoord last = centre;
+        for (int i = 1; i <= steps; i++)
         {
-            for (int x = centre.x - d; x <= centre.x + d; x++)
+            ChunkCoord point = predictChunk(position, direction, speed * prefetchSeconds * i / steps);
+            if (point == last)
+                continue;
+            last = point;
+
+            for (int x = point.x - renderDistance + 1; x < point.x + renderDistance; x++)
             {
-                for (int z = centre.z - d; z <= centre.z + d; z++)
+                for (int z = point.z - renderDistance + 1; z < point.z + renderDistance; z++)
                 {
-                    if (std::max(std::abs(x - centre.x), std::abs(z - centre.z)) != d)
-                        continue;
-
+                    ChunkCoord coord(x, z);
                     if (x < 0 || z < 0 || x >= worldWidth || z >= worldWidth)
                         continue;
 
-                    ChunkCoord coord(x, z);
+                    // Chunks already in range are handled by chunksToGenerate
+                    if (chunkDistance(coord, centre) < renderDistance || isMeshPending(coord))
+                        continue;
 
-                    if (!regenAll)
-                    {
-                        if (chunks.find(coord) == chunks.end())
-                        {
-                            chunks[coord] = new Chunk(this, coord, true);
-                            chunks[coord]->populateVoxelMap();
-                        }
-                    }
-                    else
-                    {
-                        delete chunks[coord];
-                        chunks[coord] = new Chunk(this, coord, true);
-                        chunks[coord]->populateVoxelMap();
-                    }
+                    chunksToPrefetch.push(coord);
                 }
             }
         }
+    }
+
+    // Re-sorts the queue around the player and view direction, drops queued chunks that are now out of
+    // render distance and cancels pipeline work on the chunks that just left the area in-range chunks
+    // depend on, which reaches renderDistance + 1 (see requestMesh). Call before updateRenderDistance.
+    void refocus(ChunkCoord centre, glm::vec3 forward)
+    {
+        chunksToGenerate.setFocus(centre, forward);
+        chunksToRelode.setFocus(centre, forward);
+
+        chunksToGenerate.removeIf([&](ChunkCoord coord)
+                                  { return chunkDistance(coord, centre) >= renderDistance; });
+
+        if (rangeRD >= 0)
+        {
+            forEachInSquareDifference(rangeCentre, rangeRD + 2, centre, renderDistance + 2, [&](ChunkCoord coord)
+                                      { cancelIfUnwanted(coord, centre); });
+        }
+    }
+
+    // Calls fn for every in-world chunk less than `radius` from centre (Chebyshev distance)
+    template <typename Fn>
+    static void forEachInSquare(ChunkCoord centre, int radius, Fn fn)
+    {
+        for (int x = std::max(centre.x - radius + 1, 0); x <= std::min(centre.x + radius - 1, worldWidth - 1); x++)
+            for (int z = std::max(centre.z - radius + 1, 0); z <= std::min(centre.z + radius - 1, worldWidth - 1); z++)
+                fn(ChunkCoord(x, z));
+    }
+
+    // Calls fn for every in-world chunk less than radiusA from a but not less than radiusB from b,
+    // visiting only those chunks rather than the whole square around a
+    template <typename Fn>
+    static void forEachInSquareDifference(ChunkCoord a, int radiusA, ChunkCoord b, int radiusB, Fn fn)
+    {
+        int bMinX = b.x - radiusB + 1, bMaxX = b.x + radiusB - 1;
+        int bMinZ = b.z - radiusB + 1, bMaxZ = b.z + radiusB - 1;
+
+        int minZ = std::max(a.z - radiusA + 1, 0);
+        int maxZ = std::min(a.z + radiusA - 1, worldWidth - 1);
 
-        // Add chunks to generation queue
-        for (int d = 0; d < maxDist - 1; d++)
+        for (int x = std::max(a.x - radiusA + 1, 0); x <= std::min(a.x + radiusA - 1, worldWidth - 1); x++)
         {
-            for (int x = centre.x - d; x <= centre.x + d; x++)
+            if (radiusB <= 0 || x < bMinX || x > bMaxX)
             {
-                for (int z = centre.z - d; z <= centre.z + d; z++)
-                {
-                    if (std::max(std::abs(x - centre.x), std::abs(z - centre.z)) != d)
-                        continue;
+                for (int z = minZ; z <= maxZ; z++)
+                    fn(ChunkCoord(x, z));
+                continue;
+            }
 
-                    if (x < 0 || z < 0 || x >= worldWidth || z >= worldWidth)
-                        continue;
+            // The column crosses b's square: only the runs above and below it
+            for (int z = minZ; z <= std::min(maxZ, bMinZ - 1); z++)
+                fn(ChunkCoord(x, z));
+            for (int z = std::max(minZ, bMaxZ + 1); z <= maxZ; z++)
+                fn(ChunkCoord(x, z));
+        }
+    }
 
-                    ChunkCoord coord(x, z);
-                    auto it = chunks.find(coord);
+    static int chunkDistance(ChunkCoord a, ChunkCoord b)
+    {
+        return std::max(std::abs(a.x - b.x), std::abs(a.z - b.z));
+    }
 
-                    if (!regenAll)
-                    {
-                        if (it != chunks.end() && it->second != nullptr && it->second->shouldRegen && chunksInQueue.find(coord) == chunksInQueue.end())
-                        {
-                            chunksToGenerate.push(coord);
-                            chunksInQueue.insert(coord);
-                        }
-                    }
-                    else
-                    {
-                        if (chunksInQueue.find(coord) == chunksInQueue.end())
-                        {
-                            chunksToGenerate.push(coord);
-                            chunksInQueue.insert(coord);
-                        }
-                    }
-                }
+    // Chunk pipeline. Each stage of each chunk is one job, and a job only starts once every chunk it
+    // reads or writes has reached the stage it needs:
+    //   generate C  no dependencies
+    //   decorate C  generate of C and its 8 neighbours, since trees spill up to two blocks over the border
+    //   mesh C      decorate of C and its 8 neighbours, since a diagonal neighbour's tree can reach C's border
+    // Nothing but edits writes to a chunk once it is meshed, so that is when voxel queries start to see it.
+    // These run on the simulation thread, which owns `chunks`.
+
+    JobHandle requestGenerate(ChunkCoord coord)
+    {
+        Chunk *chunk = getOrCreateChunk(coord);
+        if (!needsJob(chunk, chunk->generateJob, STAGE_GENERATED))
+            return chunk->generateJob;
+
+        std::shared_ptr<const std::vector<Lode>> set = lodeSet;
+        int version = lodeVersion;
+        chunk->generateJob = jobs.submit([this, chunk, set, version]()
+                                         {
+            if (chunk->cancelled)
+                return;
+
+            auto start = std::chrono::steady_clock::now();
+            PROFILE_SCOPE("generate job");
+            thread_local std::vector<uint8_t> saved;
+            bool loaded = regions && regions->load(chunk->coord, saved);
+
+            // A pregenerated chunk was saved whole, with the ores of the default lodes (lodeVersion 0). Trees
+            // still come from decoration, which only adds what is already there.
+            bool whole = loaded && Chunk::isWholePayload(saved) && chunk->readPayload(saved);
+            if (!whole)
+            {
+                chunk->populateVoxelMap();
+                generateCaves(chunk);
+                generateLodes(chunk, *set);
+                chunk->lodeVersion = version;
+
+                // Generation is deterministic, so the player's edits are all there is to load
+                if (loaded)
+                    chunk->readPayload(saved);
+            }
+
+            chunk->stage = STAGE_GENERATED;
+            recordJobTime(start); });
+
+        return chunk->generateJob;
+    }
+
+    JobHandle requestDecorate(ChunkCoord coord)
+    {
+        Chunk *chunk = getOrCreateChunk(coord);
+        if (!needsJob(chunk, chunk->decorateJob, STAGE_DECORATED))
+            return chunk->decorateJob;
+
+        std::vector<JobHandle> dependencies;
+        ChunkArea area = gatherArea(coord, [&](ChunkCoord c)
+                                    { dependencies.push_back(requestGenerate(c)); });
+
+        chunk->decorateJob = jobs.submit([this, chunk, area]()
+                                         {
+            if (chunk->cancelled || !area.allAtStage(STAGE_GENERATED))
+                return;
+
+            auto start = std::chrono::steady_clock::now();
+            PROFILE_SCOPE("decorate job");
+            {
+                // Trees spill into the neighbours, which overlapping decorate jobs write too. The locks are
+                // taken in coordinate order (x, then z), so two such jobs cannot deadlock.
+                std::unique_lock<std::mutex> locks[3][3];
+                for (int i = 0; i < 3; i++)
+                    for (int j = 0; j < 3; j++)
+                        if (area.chunks[i][j] != nullptr)
+                            locks[i][j] = std::unique_lock<std::mutex>(area.chunks[i][j]->decorateMutex);
+
+                generateTrees(area);
+            }
+            chunk->stage = STAGE_DECORATED;
+            recordJobTime(start); }, dependencies);
+
+        return chunk->decorateJob;
+    }
+
+    JobHandle requestMesh(ChunkCoord coord)
+    {
+        Chunk *chunk = getOrCreateChunk(coord);
+        if (!needsJob(chunk, chunk->meshJob, STAGE_MESHED))
+            return chunk->meshJob;
+
+        std::vector<JobHandle> dependencies;
+        ChunkArea area = gatherArea(coord, [&](ChunkCoord c)
+                                    { dependencies.push_back(requestDecorate(c)); });
+
+        chunk->meshJob = jobs.submit([this, chunk, area]()
+                                     {
+            // Cancelled, or a dependency was (it was out of range when this chunk was not). Either may have
+            // come back into range since, which requeueRetries sorts out.
+            if (chunk->cancelled || !area.allAtStage(STAGE_DECORATED))
+            {
+                std::lock_guard<std::mutex> lock(retryMutex);
+                meshRetries.push_back(chunk->coord);
+                return;
             }
+
+            auto start = std::chrono::steady_clock::now();
+            PROFILE_SCOPE("mesh job");
+            Chunk *neighbours[4] = {area.at(0, 1), area.at(0, -1), area.at(1, 0), area.at(-1, 0)};
+            chunk->generateMesh(neighbours);
+            chunk->stage = STAGE_MESHED;
+            chunksMeshed++;
+
+            // A lode edit came in while the chunk was in the pipeline, after setLode looked for ready chunks
+            if (chunk->lodeVersion != lodeVersion)
+            {
+                std::lock_guard<std::mutex> lock(retryMutex);
+                staleLodes.push_back(chunk->coord);
+            }
+
+            recordJobTime(start); }, dependencies);
+
+        return chunk->meshJob;
+    }
+
+    // Cancels every queued pipeline job and waits for the job system to drain, after which no worker
+    // touches any chunk. Needed before chunks are retired or worldgen settings change.
+    void stopGeneration()
+    {
+        for (auto &pair : chunks)
+        {
+            if (pair.second != nullptr)
+                pair.second->cancelled = true;
+        }
+
+        jobs.waitIdle();
+    }
+
+    // Unloads the chunks more than keepAliveDistance outside render distance, except around the
+    // prefetch lead. A chunk stays while it or a neighbour has a pipeline job in flight, since the job holds
+    // pointers to it; those are tried again on the next call.
+    void unloadDistantChunks(ChunkCoord centre)
+    {
+        PROFILE_SCOPE("unloadDistantChunks");
+
+        if (centre == unloadCentre && !unloadDeferred)
+            return;
+
+        unloadCentre = centre;
+        unloadDeferred = false;
+
+        int keep = renderDistance + keepAliveDistance;
+        std::vector<ChunkCoord> unload;
+        for (auto &pair : chunks)
+        {
+            ChunkCoord coord = pair.first;
+            if (chunkDistance(coord, centre) <= keep || (prefetchLead.x >= 0 && chunkDistance(coord, prefetchLead) <= renderDistance + 1))
+                continue;
+
+            if (hasJobsNear(coord))
+                unloadDeferred = true;
+            else
+                unload.push_back(coord);
+        }
+
+        for (ChunkCoord coord : unload)
+        {
+            Chunk *chunk = chunks[coord];
+            saveChunk(chunk);
+
+            chunks.erase(coord);
+            dirtySections.erase(coord);
+            prefetched.erase(coord);
+            retireChunk(chunk);
+        }
+    }
+
+    // Saves the edits of every chunk edited since it was loaded, and waits until they are written. Call after
+    // stopGeneration.
+    void saveAll()
+    {
+        if (!regions)
+            return;
+
+        for (auto &pair : chunks)
+            saveChunk(pair.second);
+
+        regions->flush();
+    }
+
+    // Loaded chunk at coord, or nullptr if there is none or it is still in the generation pipeline.
+    // Counts as an access: a cold chunk is expanded again.
+    Chunk *getChunk(ChunkCoord coord)
+    {
+        auto it = chunks.find(coord);
+        if (it == chunks.end() || it->second == nullptr || !it->second->isReady())
+            return nullptr;
+
+        touch(it->second);
+        return it->second;
+    }
+
+    // getChunk without counting as an access, so it changes nothing and is safe to call from several threads
+    // at once while the simulation thread waits. The caller thaws the chunks it will read beforehand (see
+    // EntityStore::step); a chunk that is cold anyway reads as not loaded rather than being thawed here.
+    Chunk *peekChunk(ChunkCoord coord) const
+    {
+        auto it = chunks.find(coord);
+        if (it == chunks.end() || it->second == nullptr || !it->second->isReady() || it->second->isCold())
+            return nullptr;
+
+        return it->second;
+    }
+
+    // Compresses the voxels of ready chunks that nothing has looked at for coldChunkSeconds, within
+    // budget. Chunks with remeshing pending, or that a pipeline job may read, stay expanded, and so do the
+    // ones around centre, which the player is about to walk into (thawing takes a few milliseconds).
+    void freezeColdChunks(ChunkCoord centre, double now, FrameBudget &budget)
+    {
+        PROFILE_SCOPE("freezeColdChunks");
+
+        accessTime = now;
+
+        ColdStats stats;
+        for (auto &pair : chunks)
+        {
+            Chunk *chunk = pair.second;
+            if (chunk == nullptr || !chunk->isReady())
+                continue;
+
+            // First time it is seen ready: start its clock
+            if (chunk->lastAccess == 0.0)
+                chunk->lastAccess = now;
+
+            if (!chunk->isCold() && now - chunk->lastAccess >= coldChunkSeconds && chunkDistance(pair.first, centre) > 1 && budget.canAfford(WORK_FREEZE) &&
+                dirtySections.count(pair.first) == 0 && !hasJobsNear(pair.first))
+            {
+                budget.run(WORK_FREEZE, [&]()
+                           {
+                    chunk->freeze();
+                    return true; });
+            }
+
+            if (chunk->isCold())
+            {
+                stats.cold++;
+                stats.bytesSaved += Chunk::expandedBytes() - chunk->packed.capacity();
+            }
+            else
+                stats.hot++;
+        }
+
+        coldStats = stats;
+    }
+
+    // Heap held by the chunks, the queues around the pipeline, the region store and the profiler.
+    // Simulation thread. The GPU side belongs to the render thread and is left at zero here.
+    void measureMemory(MemoryStats &stats)
+    {
+        PROFILE_SCOPE("measureMemory");
+
+        stats = MemoryStats();
+        for (auto &pair : chunks)
+        {
+            if (pair.second == nullptr)
+                continue;
+
+            ChunkMemory memory = pair.second->memoryUsage();
+            stats.chunks++;
+            stats.chunkTotal.add(memory);
+            if (memory.total() > stats.largestChunk.total())
+                stats.largestChunk = memory;
         }
 
-        generateCaves(centre);
-        generateLodes(centre);
-        generateTrees(centre);
+        stats.chunkMap = hashContainerBytes(chunks, sizeof(std::pair<const ChunkCoord, Chunk *>));
+
+        stats.queues = chunksToGenerate.memoryBytes() + chunksToPrefetch.memoryBytes() + chunksToRelode.memoryBytes();
+        stats.queues += hashContainerBytes(dirtySections, sizeof(std::pair<const ChunkCoord, uint32_t>));
+        stats.queues += hashContainerBytes(prefetched, sizeof(ChunkCoord));
+        stats.queues += retiredChunks.capacity() * sizeof(Chunk *);
+        {
+            std::lock_guard<std::mutex> lock(retryMutex);
+            stats.queues += (meshRetries.capacity() + staleLodes.capacity()) * sizeof(ChunkCoord);
+            stats.queues += lodeResults.capacity() * sizeof(LodeResult);
+            for (const LodeResult &result : lodeResults)
+                stats.queues += result.blocks.capacity();
+        }
+
+        if (regions)
+        {
+            stats.regionPending = regions->pendingBytes();
+            stats.regionMapped = regions->mappedBytes();
+        }
+
+        stats.profiler = profiler.memoryBytes();
+    }
+
+    bool isChunkReady(ChunkCoord coord)
+    {
+        return getChunk(coord) != nullptr;
+    }
+
+    // The chunks bordering coord in faceChecks order, for remeshing on the simulation thread.
+    // Decorated chunks count: their border with a meshed chunk no longer changes.
+    void getNeighbours(ChunkCoord coord, Chunk *neighbours[4])
+    {
+        for (int p = 0; p < 4; p++)
+        {
+            neighbours[p] = nullptr;
+
+            auto it = chunks.find(ChunkCoord(coord.x + faceChecks[p][0], coord.z + faceChecks[p][2]));
+            if (it != chunks.end() && it->second != nullptr && it->second->stage >= STAGE_DECORATED)
+            {
+                neighbours[p] = it->second;
+                touch(it->second);
+            }
+        }
     }
 
     ChunkCoord getChunkCoordFromVec3(glm::vec3 pos)
     {
         int x = floor(pos.x);
-        int y = floor(pos.y);
         int z = floor(pos.z);
 
         ChunkCoord coord = ChunkCoord();
@@ -112,9 +638,6 @@ public:
         coord.x = floor(x / chunkWidth);
         coord.z = floor(z / chunkWidth);
 
-        int localX = x % chunkWidth;
-        int localZ = z % chunkWidth;
-
         if (coord.x < 0 || pos.x < 0 || coord.z < 0 || pos.z < 0)
             return ChunkCoord();
 
@@ -153,12 +676,11 @@ public:
         if (chunkX < 0 || chunkZ < 0 || chunkX > worldWidth - 1 || chunkZ > worldWidth - 1)
             return true;
 
-        ChunkCoord real(chunkX, chunkZ);
-        auto it = chunks.find(real);
-        if (it == chunks.end() || it->second == nullptr)
+        Chunk *chunk = getChunk(ChunkCoord(chunkX, chunkZ));
+        if (chunk == nullptr)
             return false;
 
-        return it->second->voxelMap[localX][localY][localZ].isSolid;
+        return chunk->voxelMap[localX][localY][localZ].isSolid;
     }
 
     bool isVoxelSolid(int worldX, int worldY, int worldZ)
@@ -191,11 +713,95 @@ public:
         if (coord.x < 0 || worldX < 0 || coord.z < 0 || worldZ < 0 || worldY < 0 || worldY > chunkHeight - 1)
             return false;
 
-        auto it = chunks.find(coord);
-        if (it == chunks.end() || it->second == nullptr)
+        Chunk *chunk = getChunk(coord);
+        if (chunk == nullptr)
             return false;
 
-        return !it->second->voxelMap[localX][y][localZ].isAir && !it->second->voxelMap[localX][y][localZ].isLiquid;
+        return !chunk->voxelMap[localX][y][localZ].isAir && !chunk->voxelMap[localX][y][localZ].isLiquid;
+    }
+
+    // Amanatides & Woo grid traversal: visits every voxel the ray passes through exactly once, in order,
+    // and stops at the first one checkForVoxel would report (not air and not liquid).
+    // Voxels are centred on integer coordinates, so the ray is shifted by half a block before walking.
+    RaycastHit raycast(glm::vec3 origin, glm::vec3 direction, float maxDistance)
+    {
+        RaycastHit result;
+
+        if (glm::length(direction) == 0.0f)
+            return result;
+
+        glm::vec3 dir = glm::normalize(direction);
+        glm::vec3 p = origin + glm::vec3(0.5f);
+        glm::ivec3 cell = glm::ivec3(glm::floor(p));
+
+        glm::ivec3 step(0);
+        glm::vec3 tMax(std::numeric_limits<float>::infinity());
+        glm::vec3 tDelta(std::numeric_limits<float>::infinity());
+
+        for (int axis = 0; axis < 3; axis++)
+        {
+            if (dir[axis] > 0.0f)
+            {
+                step[axis] = 1;
+                tDelta[axis] = 1.0f / dir[axis];
+                tMax[axis] = (cell[axis] + 1 - p[axis]) * tDelta[axis];
+            }
+            else if (dir[axis] < 0.0f)
+            {
+                step[axis] = -1;
+                tDelta[axis] = -1.0f / dir[axis];
+                tMax[axis] = (p[axis] - cell[axis]) * tDelta[axis];
+            }
+        }
+
+        // The walk usually stays inside one or two chunks, so keep the last lookup around
+        ChunkCoord cachedCoord(-1, -1);
+        Chunk *cachedChunk = nullptr;
+
+        glm::ivec3 normal(0);
+        float t = 0.0f;
+
+        while (t <= maxDistance)
+        {
+            if (cell.x >= 0 && cell.z >= 0 && cell.y >= 0 && cell.y < chunkHeight)
+            {
+                ChunkCoord coord(cell.x / chunkWidth, cell.z / chunkWidth);
+                if (!(coord == cachedCoord))
+                {
+                    cachedCoord = coord;
+                    cachedChunk = getChunk(coord);
+                }
+
+                if (cachedChunk != nullptr)
+                {
+                    const BlockType &block = cachedChunk->voxelMap[cell.x % chunkWidth][cell.y][cell.z % chunkWidth];
+                    if (!block.isAir && !block.isLiquid)
+                    {
+                        result.hit = true;
+                        result.block = cell;
+                        result.normal = normal;
+                        result.place = cell + normal;
+                        result.distance = t;
+                        return result;
+                    }
+                }
+            }
+
+            int axis = 0;
+            if (tMax[1] < tMax[axis])
+                axis = 1;
+            if (tMax[2] < tMax[axis])
+                axis = 2;
+
+            t = tMax[axis];
+            cell[axis] += step[axis];
+            tMax[axis] += tDelta[axis];
+
+            normal = glm::ivec3(0);
+            normal[axis] = -step[axis];
+        }
+
+        return result;
     }
 
     BlockType getVoxel(int worldX, int worldY, int worldZ)
@@ -215,11 +821,24 @@ public:
         if (coord.x < 0 || worldX < 0 || coord.z < 0 || worldZ < 0 || worldY < 0 || worldY > chunkHeight - 1)
             return blockTypes[0]; // Air
 
-        auto it = chunks.find(coord);
-        if (it == chunks.end() || it->second == nullptr)
+        Chunk *chunk = getChunk(coord);
+        if (chunk == nullptr)
+            return blockTypes[0];
+
+        return chunk->voxelMap[localX][y][localZ];
+    }
+
+    // getVoxel through peekChunk
+    const BlockType &peekVoxel(int worldX, int worldY, int worldZ) const
+    {
+        if (worldX < 0 || worldZ < 0 || worldY < 0 || worldY > chunkHeight - 1)
+            return blockTypes[0];
+
+        Chunk *chunk = peekChunk(ChunkCoord(worldX / chunkWidth, worldZ / chunkWidth));
+        if (chunk == nullptr)
             return blockTypes[0];
 
-        return it->second->voxelMap[localX][y][localZ];
+        return chunk->voxelMap[worldX % chunkWidth][worldY][worldZ % chunkWidth];
     }
 
     BlockType getVoxel(ChunkCoord coord, int localX, int localY, int localZ)
@@ -254,233 +873,166 @@ public:
         if (chunkX < 0 || chunkZ < 0 || chunkX > worldWidth - 1 || chunkZ > worldWidth - 1)
             return blockTypes[0];
 
-        ChunkCoord real(chunkX, chunkZ);
-        auto it = chunks.find(real);
-        if (it == chunks.end() || it->second == nullptr)
+        Chunk *chunk = getChunk(ChunkCoord(chunkX, chunkZ));
+        if (chunk == nullptr)
             return blockTypes[0];
 
-        return it->second->voxelMap[localX][localY][localZ];
+        return chunk->voxelMap[localX][localY][localZ];
     }
 
-    void generateTrees(ChunkCoord centre)
+    void generateTrees(const ChunkArea &area)
     {
-        bool needsTreeGen = false;
-        for (int cx = centre.x - renderDistance; cx < centre.x + renderDistance; cx++)
+        PROFILE_SCOPE("trees");
+
+        placeTrees(area, area.centre, 0, chunkWidth - 1, 0, chunkWidth - 1, nullptr);
+
+        // A neighbour already decorated is not decorated again, so when this chunk is generated anew (after
+        // an unload) the trees growing in that neighbour's columns near the border are placed here, into
+        // this chunk only. Placing a tree twice changes nothing, so a neighbour that got there first is fine.
+        const int treeReach = 2;
+        for (int dx = -1; dx <= 1; dx++)
         {
-            for (int cz = centre.z - renderDistance; cz < centre.z + renderDistance; cz++)
+            for (int dz = -1; dz <= 1; dz++)
             {
-                if (cx < 0 || cz < 0 || cx >= worldWidth || cz >= worldWidth)
+                Chunk *neighbour = area.at(dx, dz);
+                if ((dx == 0 && dz == 0) || neighbour == nullptr || neighbour->stage < STAGE_DECORATED)
                     continue;
 
-                ChunkCoord coord(cx, cz);
-                auto it = chunks.find(coord);
-                if (it != chunks.end() && it->second != nullptr && !it->second->treesGenerated)
-                {
-                    needsTreeGen = true;
-                    break;
-                }
+                int x0 = dx < 0 ? chunkWidth - treeReach : 0;
+                int x1 = dx > 0 ? treeReach - 1 : chunkWidth - 1;
+                int z0 = dz < 0 ? chunkWidth - treeReach : 0;
+                int z1 = dz > 0 ? treeReach - 1 : chunkWidth - 1;
+                placeTrees(area, neighbour->coord, x0, x1, z0, z1, area.at(0, 0));
             }
-            if (needsTreeGen)
-                break;
         }
+    }
 
-        if (!needsTreeGen)
-            return;
-
-        for (int cx = centre.x - renderDistance; cx < centre.x + renderDistance; cx++)
+    // Places the trees rooted in columns [x0, x1] x [z0, z1] of chunk coord, into the chunks of area, or only
+    // into `only` when given
+    void placeTrees(const ChunkArea &area, ChunkCoord coord, int x0, int x1, int z0, int z1, const Chunk *only)
+    {
+        for (int x = x0; x <= x1; x++)
         {
-            for (int cz = centre.z - renderDistance; cz < centre.z + renderDistance; cz++)
+            for (int z = z0; z <= z1; z++)
             {
-                if (cx < 0 || cz < 0 || cx >= worldWidth || cz >= worldWidth)
-                    continue;
+                float treeZone01 = getPerlinNoise(coord.x * chunkWidth + x + treeZoneOffset, coord.z * chunkWidth + z + treeZoneOffset, treeZoneScale);
 
-                ChunkCoord coord(cx, cz);
-                auto it = chunks.find(coord);
-                if (it == chunks.end() || it->second == nullptr || it->second->treesGenerated)
-                    continue;
-
-                for (int x = 0; x < chunkWidth; x++)
+                if (treeZone01 > treeZoneThreshold)
                 {
-                    for (int z = 0; z < chunkWidth; z++)
+                    float treePlacement01 = getPerlinNoise(coord.x * chunkWidth + x + treePlacementOffset, coord.z * chunkWidth + z + treePlacementOffset, treePlacementScale);
+
+                    if (treePlacement01 > treePlacementThreshold)
                     {
-                        float treeZone01 = getPerlinNoise(coord.x * chunkWidth + x + treeZoneOffset, coord.z * chunkWidth + z + treeZoneOffset, treeZoneScale);
+                        int worldX = coord.x * chunkWidth + x;
+                        int worldZ = coord.z * chunkWidth + z;
+                        int heightValue = getTerrainHeight(worldX, worldZ);
 
-                        if (treeZone01 > treeZoneThreshold)
-                        {
-                            float treePlacement01 = getPerlinNoise(coord.x * chunkWidth + x + treePlacementOffset, coord.z * chunkWidth + z + treePlacementOffset, treePlacementScale);
+                        // Grass that no cave carved out, decided from noise rather than the voxels so edits
+                        // to the ground do not move trees around
+                        if (heightValue < 1 || heightValue >= chunkHeight - 1 || genVoxelInColumn(heightValue, heightValue) != 1 ||
+                            getCaveNoise(worldX, heightValue, worldZ) > caveGenThreshold)
+                            continue;
 
-                            if (treePlacement01 > treePlacementThreshold)
-                            {
-                                float heightValue01 = getPerlinNoise(coord.x * chunkWidth + x, coord.z * chunkWidth + z, biomeScale);
-                                int heightValue = heightValue01 * terrainHeight + terrainMinHeight;
+                        int treeY = heightValue + 1;
+                        int treeHeight = treeMinHeight + (int)(hashColumn(worldX, worldZ) % (uint32_t)(treeMaxHeight - treeMinHeight));
 
-                                if (getVoxel(coord.x * chunkWidth + x, heightValue, coord.z * chunkWidth + z) != blockTypes[1])
-                                    continue;
+                        if (treeY + treeHeight < chunkHeight)
+                        {
 
-                                int treeY = heightValue + 1;
-                                int treeHeight = treeMinHeight + (rand() % (treeMaxHeight - treeMinHeight));
+                            // Place trunk
+                            for (int i = 0; i < treeHeight; i++)
+                                placeTreeVoxel(area, only, worldX, treeY + i, worldZ, 4);
 
-                                if (treeY + treeHeight < chunkHeight)
+                            // Place leaves
+                            for (int lx = -2; lx <= 2; lx++)
+                            {
+                                for (int lz = -2; lz <= 2; lz++)
                                 {
-                                    int worldX = coord.x * chunkWidth + x;
-                                    int worldZ = coord.z * chunkWidth + z;
-
-                                    // Place trunk
-                                    for (int i = 0; i < treeHeight; i++)
-                                        placeTreeVoxel(worldX, treeY + i, worldZ, 4);
-
-                                    // Place leaves
-                                    for (int lx = -2; lx <= 2; lx++)
+                                    for (int ly = treeHeight - 3; ly < treeHeight - 1; ly++)
                                     {
-                                        for (int lz = -2; lz <= 2; lz++)
-                                        {
-                                            for (int ly = treeHeight - 3; ly < treeHeight - 1; ly++)
-                                            {
-                                                if (lx != 0 || lz != 0)
-                                                    placeTreeVoxel(worldX + lx, treeY + ly, worldZ + lz, 5);
-                                            }
-                                        }
+                                        if (lx != 0 || lz != 0)
+                                            placeTreeVoxel(area, only, worldX + lx, treeY + ly, worldZ + lz, 5);
                                     }
+                                }
+                            }
 
-                                    for (int lx = -1; lx <= 1; lx++)
-                                    {
-                                        for (int lz = -1; lz <= 1; lz++)
-                                        {
-                                            if (lx != 0 || lz != 0)
-                                                placeTreeVoxel(worldX + lx, treeY + treeHeight - 1, worldZ + lz, 5);
-                                        }
-                                    }
-
-                                    placeTreeVoxel(worldX + 1, treeY + treeHeight, worldZ, 5);
-                                    placeTreeVoxel(worldX, treeY + treeHeight, worldZ + 1, 5);
-                                    placeTreeVoxel(worldX - 1, treeY + treeHeight, worldZ, 5);
-                                    placeTreeVoxel(worldX, treeY + treeHeight, worldZ - 1, 5);
-                                    placeTreeVoxel(worldX, treeY + treeHeight, worldZ, 5);
-
-                                    it->second->shouldRegen = true;
+                            for (int lx = -1; lx <= 1; lx++)
+                            {
+                                for (int lz = -1; lz <= 1; lz++)
+                                {
+                                    if (lx != 0 || lz != 0)
+                                        placeTreeVoxel(area, only, worldX + lx, treeY + treeHeight - 1, worldZ + lz, 5);
                                 }
                             }
+
+                            placeTreeVoxel(area, only, worldX + 1, treeY + treeHeight, worldZ, 5);
+                            placeTreeVoxel(area, only, worldX, treeY + treeHeight, worldZ + 1, 5);
+                            placeTreeVoxel(area, only, worldX - 1, treeY + treeHeight, worldZ, 5);
+                            placeTreeVoxel(area, only, worldX, treeY + treeHeight, worldZ - 1, 5);
+                            placeTreeVoxel(area, only, worldX, treeY + treeHeight, worldZ, 5);
                         }
                     }
                 }
-
-                it->second->treesGenerated = true;
             }
         }
     }
 
-    void placeTreeVoxel(int worldX, int worldY, int worldZ, int blockType)
+    void placeTreeVoxel(const ChunkArea &area, const Chunk *only, int worldX, int worldY, int worldZ, int blockType)
     {
-        ChunkCoord coord;
-        coord.x = floor(worldX / chunkWidth);
-        coord.z = floor(worldZ / chunkWidth);
+        if (worldX < 0 || worldZ < 0 || worldY < 0 || worldY >= chunkHeight)
+            return;
 
-        int localX = worldX % chunkWidth;
-        int localZ = worldZ % chunkWidth;
+        int dx = worldX / chunkWidth - area.centre.x;
+        int dz = worldZ / chunkWidth - area.centre.z;
+        if (dx < -1 || dx > 1 || dz < -1 || dz > 1)
+            return;
 
-        if (coord.x < 0 || coord.z < 0 || coord.x >= worldWidth || coord.z >= worldWidth)
+        // A ready chunk had all its neighbours decorated before, and trees always come out the same,
+        // so a neighbour decorated again after being unloaded has nothing new to add to it
+        Chunk *chunk = area.at(dx, dz);
+        if (chunk == nullptr || chunk->isReady() || (only != nullptr && chunk != only))
             return;
-        if (worldY < 0 || worldY >= chunkHeight)
+
+        int localX = worldX % chunkWidth;
+        int localZ = worldZ % chunkWidth;
+        if (chunk->edits.count(Chunk::voxelIndex(localX, worldY, localZ)))
             return;
 
-        auto it = chunks.find(coord);
-        if (it != chunks.end() && it->second != nullptr)
-        {
-            if (it->second->voxelMap[localX][worldY][localZ].isAir)
-            {
-                it->second->voxelMap[localX][worldY][localZ] = blockTypes[blockType];
-            }
-        }
+        // Trunks win over leaves, so overlapping trees look the same whichever chunk is decorated first
+        BlockType &voxel = chunk->voxelMap[localX][worldY][localZ];
+        if (voxel.isAir || (blockType == 4 && voxel == blockTypes[5]))
+            voxel = blockTypes[blockType];
     }
 
-    void generateCaves(ChunkCoord centre)
+    void generateCaves(Chunk *chunk)
     {
-        bool needsCaveGen = false;
-        for (int cx = centre.x - renderDistance; cx < centre.x + renderDistance; cx++)
-        {
-            for (int cz = centre.z - renderDistance; cz < centre.z + renderDistance; cz++)
-            {
-                if (cx < 0 || cz < 0 || cx >= worldWidth || cz >= worldWidth)
-                    continue;
+        PROFILE_SCOPE("caves");
 
-                ChunkCoord coord(cx, cz);
-                auto it = chunks.find(coord);
-                if (it != chunks.end() && it->second != nullptr && !it->second->cavesGenerated)
-                {
-                    needsCaveGen = true;
-                    break;
-                }
-            }
-            if (needsCaveGen)
-                break;
-        }
+        ChunkCoord coord = chunk->coord;
 
-        if (!needsCaveGen)
-            return;
-
-        for (int cx = centre.x - renderDistance; cx < centre.x + renderDistance; cx++)
+        for (int x = 0; x < chunkWidth; x++)
         {
-            for (int cz = centre.z - renderDistance; cz < centre.z + renderDistance; cz++)
+            for (int y = 1; y < chunkHeight - 1; y++)
             {
-                if (cx < 0 || cz < 0 || cx >= worldWidth || cz >= worldWidth)
-                    continue;
-
-                ChunkCoord coord(cx, cz);
-                auto it = chunks.find(coord);
-                if (it == chunks.end() || it->second == nullptr || it->second->cavesGenerated)
-                    continue;
-
-                bool chunkModified = false;
-
-                for (int x = 0; x < chunkWidth; x++)
+                for (int z = 0; z < chunkWidth; z++)
                 {
-                    for (int y = 1; y < chunkHeight - 1; y++)
-                    {
-                        for (int z = 0; z < chunkWidth; z++)
-                        {
-                            int worldX = coord.x * chunkWidth + x;
-                            int worldZ = coord.z * chunkWidth + z;
-
-                            float caveNoise = getCaveNoise(worldX, y, worldZ);
+                    int worldX = coord.x * chunkWidth + x;
+                    int worldZ = coord.z * chunkWidth + z;
 
-                            if (caveNoise > caveGenThreshold && !it->second->voxelMap[x][y][z].isAir)
-                            {
-                                it->second->voxelMap[x][y][z] = blockTypes[0];
-                                chunkModified = true;
-                            }
-                        }
-                    }
-                }
+                    float caveNoise = getCaveNoise(worldX, y, worldZ);
 
-                if (chunkModified)
-                {
-                    it->second->shouldRegen = true;
+                    if (caveNoise > caveGenThreshold && !chunk->voxelMap[x][y][z].isAir)
+                        chunk->voxelMap[x][y][z] = blockTypes[0];
                 }
-
-                it->second->cavesGenerated = true;
             }
         }
     }
 
-    void generateCave(ChunkCoord coord)
+    void generateLodes(Chunk *chunk, const std::vector<Lode> &set)
     {
-        bool needsCaveGen = false;
-        int cx = coord.x;
-        int cz = coord.z;
-        if (cx < 0 || cz < 0 || cx >= worldWidth || cz >= worldWidth)
-            return;
-
-        auto it = chunks.find(coord);
-        if (it != chunks.end() && it->second != nullptr && !it->second->cavesGenerated)
-            needsCaveGen = true;
-
-        if (!needsCaveGen)
-            return;
-
-        if (it == chunks.end() || it->second == nullptr || it->second->cavesGenerated)
-            return;
+        PROFILE_SCOPE("lodes");
 
-        bool chunkModified = false;
+        ChunkCoord coord = chunk->coord;
 
         for (int x = 0; x < chunkWidth; x++)
         {
@@ -488,108 +1040,56 @@ public:
             {
                 for (int z = 0; z < chunkWidth; z++)
                 {
-                    int worldX = coord.x * chunkWidth + x;
-                    int worldZ = coord.z * chunkWidth + z;
-
-                    float caveNoise = getCaveNoise(worldX, y, worldZ);
-
-                    if (caveNoise > caveGenThreshold && !it->second->voxelMap[x][y][z].isAir)
-                    {
-                        it->second->voxelMap[x][y][z] = blockTypes[0];
-                        chunkModified = true;
-                    }
+                    if (chunk->voxelMap[x][y][z] == blockTypes[3])
+                        chunk->voxelMap[x][y][z] = blockTypes[lodeBlockAt(set, coord.x * chunkWidth + x, y, coord.z * chunkWidth + z)];
                 }
             }
         }
-
-        if (chunkModified)
-            it->second->shouldRegen = true;
-
-        it->second->cavesGenerated = true;
     }
 
-    void generateLodes(ChunkCoord centre)
+    // What the ore stage turns a stone voxel into: the block of the first lode whose noise passes there
+    int lodeBlockAt(const std::vector<Lode> &set, int worldX, int y, int worldZ)
     {
-        bool needsLodeGen = false;
-        for (int cx = centre.x - renderDistance; cx < centre.x + renderDistance; cx++)
+        for (const Lode &lode : set)
         {
-            for (int cz = centre.z - renderDistance; cz < centre.z + renderDistance; cz++)
-            {
-                if (cx < 0 || cz < 0 || cx >= worldWidth || cz >= worldWidth)
-                    continue;
+            if (y < lode.minHeight || y > lode.maxHeight)
+                continue;
 
-                ChunkCoord coord(cx, cz);
-                auto it = chunks.find(coord);
-                if (it != chunks.end() && it->second != nullptr && !it->second->lodesGenerated)
-                {
-                    needsLodeGen = true;
-                    break;
-                }
-            }
-            if (needsLodeGen)
-                break;
+            if (getPerlinNoise3D(worldX + lode.offset, y, worldZ + lode.offset, lode.scale) > lode.threshold)
+                return lode.blockID;
         }
 
-        if (!needsLodeGen)
-            return;
-
-        for (int cx = centre.x - renderDistance; cx < centre.x + renderDistance; cx++)
-        {
-            for (int cz = centre.z - renderDistance; cz < centre.z + renderDistance; cz++)
-            {
-                if (cx < 0 || cz < 0 || cx >= worldWidth || cz >= worldWidth)
-                    continue;
-
-                ChunkCoord coord(cx, cz);
-                auto it = chunks.find(coord);
-                if (it == chunks.end() || it->second == nullptr || it->second->lodesGenerated)
-                    continue;
-
-                bool chunkModified = false;
-
-                for (int x = 0; x < chunkWidth; x++)
-                {
-                    for (int y = 1; y < chunkHeight - 1; y++)
-                    {
-                        for (int z = 0; z < chunkWidth; z++)
-                        {
-                            int worldX = coord.x * chunkWidth + x;
-                            int worldZ = coord.z * chunkWidth + z;
-
-                            for (int l = 0; l < lodeCount; l++)
-                            {
-                                const Lode &lode = lodes[l];
-
-                                if (y < lode.minHeight || y > lode.maxHeight)
-                                    continue;
-
-                                float lodeNoise = getPerlinNoise3D(worldX + lode.offset, y, worldZ + lode.offset, lode.scale);
+        return 3; // Stone
+    }
 
-                                if (lodeNoise > lode.threshold && it->second->voxelMap[x][y][z] == blockTypes[3])
-                                {
-                                    it->second->voxelMap[x][y][z] = blockTypes[lode.blockID];
-                                    chunkModified = true;
-                                }
-                            }
-                        }
-                    }
-                }
+    // Changes one lode and re-runs only the ore stage, and only between the heights the lode covered
+    // before or covers now. Terrain, caves and trees stay as they are, and just the sections that
+    // changed are remeshed.
+    void setLode(int index, const Lode &lode)
+    {
+        const Lode &old = (*lodeSet)[index];
+        lodeBands.push_back(glm::ivec2(std::max((int)std::min(old.minHeight, lode.minHeight), 1),
+                                       std::min((int)std::max(old.maxHeight, lode.maxHeight), chunkHeight - 2)));
 
-                if (chunkModified)
-                {
-                    it->second->shouldRegen = true;
-                }
+        std::shared_ptr<std::vector<Lode>> next = std::make_shared<std::vector<Lode>>(*lodeSet);
+        (*next)[index] = lode;
+        lodeSet = next;
+        lodeVersion++;
 
-                it->second->lodesGenerated = true;
-            }
+        for (auto &pair : chunks)
+        {
+            if (pair.second != nullptr && pair.second->isReady())
+                chunksToRelode.push(pair.first);
         }
     }
 
     int genVoxel(ChunkCoord coord, int x, int y, int z)
     {
-        float heightValue01 = getPerlinNoise(coord.x * chunkWidth + x, coord.z * chunkWidth + z, biomeScale);
-        int heightValue = heightValue01 * terrainHeight + terrainMinHeight;
+        return genVoxelInColumn(getTerrainHeight(coord.x * chunkWidth + x, coord.z * chunkWidth + z), y);
+    }
 
+    int genVoxelInColumn(int heightValue, int y)
+    {
         int voxel = 0;
 
         if (y > heightValue)
@@ -644,47 +1144,653 @@ public:
         if (coord.x < 0 || worldX < 0 || coord.z < 0 || worldZ < 0 || worldY < 0 || worldY > chunkHeight - 1)
             return;
 
-        auto it = chunks.find(coord);
-        if (it != chunks.end() && it->second != nullptr)
+        Chunk *chunk = getChunk(coord);
+        if (chunk == nullptr)
+            return;
+
+        // A neighbour's mesh job may be reading this border; the edit is tried again once it is done
+        if (!borderMeshJobs(coord, localX, localX, localZ, localZ).empty())
         {
-            it->second->setVoxel(localX, y, localZ, block);
+            deferredEdits.push_back({glm::ivec3(x, y, z), block});
+            return;
         }
+
+        chunk->setVoxel(localX, y, localZ, block);
     }
 
-    void regenerateChunks(ChunkCoord origin, int localX, int localZ)
+    // Queues the sections holding edited voxels in rows [y0, y1] for remeshing, plus the section
+    // above or below when an edit sits on a section face and any neighbour whose border faces it
+    void markChunksDirty(ChunkCoord origin, int localX, int localZ, int y0, int y1)
     {
-        auto it = chunks.find(origin);
-        if (it != chunks.end() && it->second != nullptr)
+        markChunkDirty(origin, sectionMask(y0 - 1, y1 + 1));
+
+        uint32_t neighbourMask = sectionMask(y0, y1);
+
+        if (localX == 0 && origin.x > 0)
+            markChunkDirty(ChunkCoord(origin.x - 1, origin.z), neighbourMask);
+
+        if (localZ == 0 && origin.z > 0)
+            markChunkDirty(ChunkCoord(origin.x, origin.z - 1), neighbourMask);
+
+        if (localX == chunkWidth - 1 && origin.x < worldWidth - 1)
+            markChunkDirty(ChunkCoord(origin.x + 1, origin.z), neighbourMask);
+
+        if (localZ == chunkWidth - 1 && origin.z < worldWidth - 1)
+            markChunkDirty(ChunkCoord(origin.x, origin.z + 1), neighbourMask);
+    }
+
+    void markChunkDirty(ChunkCoord coord, uint32_t sections)
+    {
+        if (getChunk(coord) != nullptr)
+            dirtySections[coord] |= sections;
+    }
+
+    // Bit per section overlapping rows [y0, y1], clamped to the chunk
+    uint32_t sectionMask(int y0, int y1)
+    {
+        int first = std::max(y0, 0) / sectionHeight;
+        int last = std::min(y1, chunkHeight - 1) / sectionHeight;
+
+        uint32_t mask = 0;
+        for (int s = first; s <= last; s++)
+            mask |= 1u << s;
+        return mask;
+    }
+
+    // Remeshes sections edited since the last flush exactly once, nearest to the player first, for as
+    // long as the budget allows. Chunks that do not fit stay dirty for the next flush.
+    void flushDirtySections(ChunkCoord priority, FrameBudget &budget)
+    {
+        PROFILE_SCOPE("flushDirtySections");
+
+        if (dirtySections.empty())
+            return;
+
+        std::vector<std::pair<ChunkCoord, uint32_t>> order(dirtySections.begin(), dirtySections.end());
+        dirtySections.clear();
+
+        std::sort(order.begin(), order.end(), [&](const std::pair<ChunkCoord, uint32_t> &a, const std::pair<ChunkCoord, uint32_t> &b)
+                  { return std::max(std::abs(a.first.x - priority.x), std::abs(a.first.z - priority.z)) <
+                           std::max(std::abs(b.first.x - priority.x), std::abs(b.first.z - priority.z)); });
+
+        size_t next = 0;
+        for (; next < order.size() && budget.canAfford(WORK_REMESH); next++)
         {
-            it->second->generateMesh();
+            const auto &entry = order[next];
+
+            budget.run(WORK_REMESH, [&]()
+                       {
+                Chunk *chunk = getChunk(entry.first);
+                if (chunk == nullptr)
+                    return false;
+
+                Chunk *neighbours[4];
+                getNeighbours(entry.first, neighbours);
+
+                for (int s = 0; s < (int)chunk->sections.size(); s++)
+                {
+                    if (entry.second & (1u << s))
+                        chunk->generateSectionMesh(s, neighbours);
+                }
+                return true; });
         }
 
-        if (localX == 0 && origin.x > 0)
+        for (; next < order.size(); next++)
+            dirtySections[order[next].first] |= order[next].second;
+    }
+
+    // Bulk edits write straight into chunk storage and only mark the touched chunks dirty,
+    // so each touched section is remeshed once by the next flushDirtySections however many voxels changed.
+    // Every voxel written is recorded as an edit, like setVoxel, so it is saved with the chunk.
+    // Regions are inclusive world block coordinates. Each returns the number of voxels written.
+
+    int fillRegion(glm::ivec3 a, glm::ivec3 b, int block)
+    {
+        int written = 0;
+        const BlockType &type = blockTypes[block];
+
+        forEachChunkSpan(a, b, [&](Chunk *chunk, int x0, int x1, int y0, int y1, int z0, int z1, glm::ivec3)
+                         {
+            for (int x = x0; x <= x1; x++)
+            {
+                for (int y = y0; y <= y1; y++)
+                {
+                    std::fill(chunk->voxelMap[x][y].begin() + z0, chunk->voxelMap[x][y].begin() + z1 + 1, type);
+                    for (int z = z0; z <= z1; z++)
+                        chunk->recordEdit(x, y, z, type.id);
+                }
+            }
+
+            written += (x1 - x0 + 1) * (y1 - y0 + 1) * (z1 - z0 + 1);
+            return true; });
+
+        return written;
+    }
+
+    int replaceRegion(glm::ivec3 a, glm::ivec3 b, int fromBlock, int toBlock)
+    {
+        int written = 0;
+        uint8_t from = (uint8_t)fromBlock;
+        const BlockType &to = blockTypes[toBlock];
+
+        forEachChunkSpan(a, b, [&](Chunk *chunk, int x0, int x1, int y0, int y1, int z0, int z1, glm::ivec3)
+                         {
+            int before = written;
+
+            for (int x = x0; x <= x1; x++)
+            {
+                for (int y = y0; y <= y1; y++)
+                {
+                    for (int z = z0; z <= z1; z++)
+                    {
+                        BlockType &voxel = chunk->voxelMap[x][y][z];
+                        if (voxel.id == from)
+                        {
+                            voxel = to;
+                            chunk->recordEdit(x, y, z, to.id);
+                            written++;
+                        }
+                    }
+                }
+            }
+
+            return written != before; });
+
+        return written;
+    }
+
+    int fillSphere(glm::ivec3 centre, float radius, int block)
+    {
+        int written = 0;
+        const BlockType &type = blockTypes[block];
+        int r = (int)ceil(radius);
+        float radiusSq = radius * radius;
+
+        forEachChunkSpan(centre - glm::ivec3(r), centre + glm::ivec3(r), [&](Chunk *chunk, int x0, int x1, int y0, int y1, int z0, int z1, glm::ivec3 base)
+                         {
+            int before = written;
+
+            for (int x = x0; x <= x1; x++)
+            {
+                float dx = (float)(base.x + x - centre.x);
+                for (int y = y0; y <= y1; y++)
+                {
+                    float dy = (float)(y - centre.y);
+                    float remaining = radiusSq - dx * dx - dy * dy;
+                    if (remaining < 0.0f)
+                        continue;
+
+                    // Each x/y row crosses the sphere as a single z run
+                    int halfRun = (int)floor(sqrt(remaining));
+                    int runStart = std::max(centre.z - halfRun - base.z, z0);
+                    int runEnd = std::min(centre.z + halfRun - base.z, z1);
+                    if (runStart > runEnd)
+                        continue;
+
+                    std::fill(chunk->voxelMap[x][y].begin() + runStart, chunk->voxelMap[x][y].begin() + runEnd + 1, type);
+                    for (int z = runStart; z <= runEnd; z++)
+                        chunk->recordEdit(x, y, z, type.id);
+                    written += runEnd - runStart + 1;
+                }
+            }
+
+            return written != before; });
+
+        return written;
+    }
+
+    RegionBuffer copyRegion(glm::ivec3 a, glm::ivec3 b)
+    {
+        glm::ivec3 lo = glm::min(a, b);
+        glm::ivec3 hi = glm::max(a, b);
+
+        RegionBuffer buffer;
+        buffer.size = hi - lo + glm::ivec3(1);
+        buffer.blocks.assign((size_t)buffer.size.x * buffer.size.y * buffer.size.z, blockTypes[0]);
+
+        // Voxels outside loaded chunks stay air
+        forEachChunkSpan(lo, hi, [&](Chunk *chunk, int x0, int x1, int y0, int y1, int z0, int z1, glm::ivec3 base)
+                         {
+            for (int x = x0; x <= x1; x++)
+                for (int y = y0; y <= y1; y++)
+                    std::copy(chunk->voxelMap[x][y].begin() + z0, chunk->voxelMap[x][y].begin() + z1 + 1,
+                              &buffer.at(base.x + x - lo.x, y - lo.y, base.z + z0 - lo.z));
+
+            return false; });
+
+        return buffer;
+    }
+
+    int pasteRegion(RegionBuffer &buffer, glm::ivec3 origin, bool skipAir = false)
+    {
+        if (buffer.blocks.empty())
+            return 0;
+
+        int written = 0;
+
+        forEachChunkSpan(origin, origin + buffer.size - glm::ivec3(1), [&](Chunk *chunk, int x0, int x1, int y0, int y1, int z0, int z1, glm::ivec3 base)
+                         {
+            int before = written;
+
+            for (int x = x0; x <= x1; x++)
+            {
+                for (int y = y0; y <= y1; y++)
+                {
+                    BlockType *src = &buffer.at(base.x + x - origin.x, y - origin.y, base.z + z0 - origin.z);
+
+                    for (int z = z0; z <= z1; z++, src++)
+                    {
+                        if (skipAir && src->isAir)
+                            continue;
+                        chunk->voxelMap[x][y][z] = *src;
+                        chunk->recordEdit(x, y, z, src->id);
+                        written++;
+                    }
+                }
+            }
+
+            return written != before; });
+
+        return written;
+    }
+
+    // Clamps the box to the world and calls fn once per loaded chunk it overlaps with the local
+    // inclusive span inside that chunk and the chunk's world block origin. fn returns whether it
+    // modified the chunk, in which case the chunk and any neighbour sharing an edited border are marked dirty.
+    // Waits first for neighbours' mesh jobs that may be reading the span's borders.
+    template <typename Fn>
+    void forEachChunkSpan(glm::ivec3 a, glm::ivec3 b, Fn fn)
+    {
+        glm::ivec3 lo = glm::max(glm::min(a, b), glm::ivec3(0));
+        glm::ivec3 hi = glm::min(glm::max(a, b), glm::ivec3(worldWidth * chunkWidth - 1, chunkHeight - 1, worldWidth * chunkWidth - 1));
+
+        if (lo.x > hi.x || lo.y > hi.y || lo.z > hi.z)
+            return;
+
+        for (int cx = lo.x / chunkWidth; cx <= hi.x / chunkWidth; cx++)
+        {
+            for (int cz = lo.z / chunkWidth; cz <= hi.z / chunkWidth; cz++)
+            {
+                ChunkCoord coord(cx, cz);
+                Chunk *chunk = getChunk(coord);
+                if (chunk == nullptr)
+                    continue;
+
+                glm::ivec3 base(cx * chunkWidth, 0, cz * chunkWidth);
+                int x0 = std::max(lo.x - base.x, 0);
+                int x1 = std::min(hi.x - base.x, chunkWidth - 1);
+                int z0 = std::max(lo.z - base.z, 0);
+                int z1 = std::min(hi.z - base.z, chunkWidth - 1);
+
+                for (const JobHandle &job : borderMeshJobs(coord, x0, x1, z0, z1))
+                    JobSystem::waitUntilDone(job);
+
+                if (fn(chunk, x0, x1, lo.y, hi.y, z0, z1, base))
+                {
+                    markChunksDirty(coord, x0, z0, lo.y, hi.y);
+                    markChunksDirty(coord, x1, z1, lo.y, hi.y);
+                }
+            }
+        }
+    }
+private:
+    std::mutex retryMutex;
+    std::vector<ChunkCoord> meshRetries; // Written by mesh jobs, drained by submitQueuedChunks
+    std::vector<LodeResult> lodeResults; // Written by ore stage jobs, drained by rerunLodes
+    std::vector<ChunkCoord> staleLodes;  // Meshed with lodes older than lodeVersion, drained by rerunLodes
+
+    std::vector<glm::ivec2> lodeBands; // Heights touched by each setLode, indexed by the version it replaced
+
+    std::vector<std::pair<glm::ivec3, int>> deferredEdits; // setVoxel calls held back by borderMeshJobs
+
+    // Mesh range as of the last updateRenderDistance, to spot chunks coming into it
+    ChunkCoord rangeCentre;
+    int rangeRD = -1;
+
+    ChunkCoord prefetchCentre = ChunkCoord(-1, -1);
+    ChunkCoord prefetchLead = ChunkCoord(-1, -1);
+
+    ChunkCoord unloadCentre = ChunkCoord(-1, -1);
+    bool unloadDeferred = false; // Some chunk was kept back for a job in flight
+    std::unordered_set<ChunkCoord> prefetched; // Requested by the prefetcher and not in range yet
+
+    // Puts chunks whose mesh job gave up back in the queue once that job has finished, if still in range.
+    // Requesting them again restarts whatever dependency was cancelled.
+    void requeueRetries()
+    {
+        std::vector<ChunkCoord> retries;
         {
-            auto neighbor = chunks.find(ChunkCoord(origin.x - 1, origin.z));
-            if (neighbor != chunks.end() && neighbor->second != nullptr)
-                neighbor->second->generateMesh();
+            std::lock_guard<std::mutex> lock(retryMutex);
+            retries.swap(meshRetries);
         }
 
-        if (localZ == 0 && origin.z > 0)
+        std::vector<ChunkCoord> notFinished;
+        for (ChunkCoord coord : retries)
         {
-            auto neighbor = chunks.find(ChunkCoord(origin.x, origin.z - 1));
-            if (neighbor != chunks.end() && neighbor->second != nullptr)
-                neighbor->second->generateMesh();
+            auto it = chunks.find(coord);
+            if (it == chunks.end() || it->second == nullptr)
+                continue;
+
+            if (!JobSystem::isDone(it->second->meshJob))
+                notFinished.push_back(coord);
+            else if (rangeRD >= 0 && chunkDistance(coord, rangeCentre) < rangeRD)
+                chunksToGenerate.push(coord);
         }
 
-        if (localX == chunkWidth - 1 && origin.x < worldWidth - 1)
+        if (!notFinished.empty())
         {
-            auto neighbor = chunks.find(ChunkCoord(origin.x + 1, origin.z));
-            if (neighbor != chunks.end() && neighbor->second != nullptr)
-                neighbor->second->generateMesh();
+            std::lock_guard<std::mutex> lock(retryMutex);
+            meshRetries.insert(meshRetries.end(), notFinished.begin(), notFinished.end());
         }
+    }
 
-        if (localZ == chunkWidth - 1 && origin.z < worldWidth - 1)
+    void touch(Chunk *chunk)
+    {
+        chunk->lastAccess = accessTime;
+        if (chunk->isCold())
+            chunk->thaw();
+    }
+
+    // Unedited chunks are never written: they regenerate exactly as they were
+    void saveChunk(Chunk *chunk)
+    {
+        if (!regions || chunk == nullptr || !chunk->unsaved)
+            return;
+
+        PROFILE_SCOPE("saveChunk");
+        std::vector<uint8_t> payload;
+        chunk->writeEdits(payload);
+        regions->save(chunk->coord, std::move(payload));
+        chunk->unsaved = false;
+    }
+
+    bool hasJobsNear(ChunkCoord coord)
+    {
+        for (int dx = -1; dx <= 1; dx++)
+        {
+            for (int dz = -1; dz <= 1; dz++)
+            {
+                auto it = chunks.find(ChunkCoord(coord.x + dx, coord.z + dz));
+                if (it == chunks.end() || it->second == nullptr)
+                    continue;
+
+                Chunk *chunk = it->second;
+                if (!JobSystem::isDone(chunk->generateJob) || !JobSystem::isDone(chunk->decorateJob) ||
+                    !JobSystem::isDone(chunk->meshJob) || !JobSystem::isDone(chunk->lodeJob))
+                    return true;
+            }
+        }
+
+        return false;
+    }
+
+    // Ore stage re-runs after setLode. A job works out from noise alone what each voxel in the band should be,
+    // so it never reads a ready chunk; the result is written in here, on the thread that owns those voxels.
+    void rerunLodes()
+    {
+        std::vector<LodeResult> results;
+        std::vector<ChunkCoord> stale;
+        {
+            std::lock_guard<std::mutex> lock(retryMutex);
+            results.swap(lodeResults);
+            stale.swap(staleLodes);
+        }
+
+        for (ChunkCoord coord : stale)
+            chunksToRelode.push(coord);
+
+        std::vector<LodeResult> waiting;
+        for (LodeResult &result : results)
+        {
+            if (!applyLodes(result))
+                waiting.push_back(std::move(result));
+        }
+
+        if (!waiting.empty())
         {
-            auto neighbor = chunks.find(ChunkCoord(origin.x, origin.z + 1));
-            if (neighbor != chunks.end() && neighbor->second != nullptr)
-                neighbor->second->generateMesh();
+            std::lock_guard<std::mutex> lock(retryMutex);
+            for (LodeResult &result : waiting)
+                lodeResults.push_back(std::move(result));
         }
+
+        while (!chunksToRelode.empty())
+        {
+            Chunk *chunk = getChunk(chunksToRelode.pop());
+
+            // A chunk with a job still running is queued again when its result comes in
+            if (chunk == nullptr || chunk->lodeVersion == lodeVersion || !JobSystem::isDone(chunk->lodeJob))
+                continue;
+
+            // Every edit since the chunk's ore stage last ran
+            glm::ivec2 band(chunkHeight, -1);
+            for (int v = chunk->lodeVersion; v < lodeVersion; v++)
+                band = glm::ivec2(std::min(band.x, lodeBands[v].x), std::max(band.y, lodeBands[v].y));
+
+            std::shared_ptr<const std::vector<Lode>> set = lodeSet;
+            int version = lodeVersion;
+            chunk->lodeJob = jobs.submit([this, chunk, set, version, band]()
+                                         {
+                PROFILE_SCOPE("lode job");
+                LodeResult result;
+                result.chunk = chunk;
+                result.coord = chunk->coord;
+                result.version = version;
+                result.band = band;
+
+                int bandHeight = std::max(band.y - band.x + 1, 0);
+                result.blocks.assign((size_t)chunkWidth * bandHeight * chunkWidth, 0);
+
+                for (int x = 0; x < chunkWidth; x++)
+                {
+                    for (int z = 0; z < chunkWidth; z++)
+                    {
+                        int worldX = result.coord.x * chunkWidth + x;
+                        int worldZ = result.coord.z * chunkWidth + z;
+                        int heightValue = getTerrainHeight(worldX, worldZ);
+
+                        for (int y = band.x; y <= band.y; y++)
+                        {
+                            if (genVoxelInColumn(heightValue, y) == 3)
+                                result.blocks[(x * bandHeight + y - band.x) * chunkWidth + z] = (uint8_t)lodeBlockAt(*set, worldX, y, worldZ);
+                        }
+                    }
+                }
+
+                std::lock_guard<std::mutex> lock(retryMutex);
+                lodeResults.push_back(std::move(result)); });
+        }
+    }
+
+    // Returns false if the result has to wait because a neighbour's mesh job may be reading this chunk's border
+    bool applyLodes(const LodeResult &result)
+    {
+        Chunk *chunk = getChunk(result.coord);
+        if (chunk == nullptr || chunk != result.chunk || chunk->lodeVersion >= result.version)
+            return true;
+
+        if (!borderMeshJobs(result.coord, 0, chunkWidth - 1, 0, chunkWidth - 1).empty())
+            return false;
+
+        int bandHeight = std::max(result.band.y - result.band.x + 1, 0);
+        uint32_t changed = 0;
+
+        for (int x = 0; x < chunkWidth; x++)
+        {
+            for (int y = result.band.x; y <= result.band.y; y++)
+            {
+                for (int z = 0; z < chunkWidth; z++)
+                {
+                    uint8_t block = result.blocks[(x * bandHeight + y - result.band.x) * chunkWidth + z];
+                    BlockType &voxel = chunk->voxelMap[x][y][z];
+
+                    // Caves and trees may have put something else there, and the player's edits stay
+                    if (block == 0 || voxel == blockTypes[block] || !isOreStageBlock(voxel) || chunk->edits.count(Chunk::voxelIndex(x, y, z)))
+                        continue;
+
+                    voxel = blockTypes[block];
+                    changed |= 1u << (y / sectionHeight);
+                }
+            }
+        }
+
+        chunk->lodeVersion = result.version;
+        if (changed != 0)
+            markChunkDirty(result.coord, changed);
+
+        if (result.version != lodeVersion)
+            chunksToRelode.push(result.coord);
+
+        return true;
+    }
+
+    // Mesh jobs in flight for neighbours across the borders that the local span [x0, x1] x [z0, z1] of coord
+    // touches. Those jobs read the border voxels, so a ready chunk's border must not change under them.
+    std::vector<JobHandle> borderMeshJobs(ChunkCoord coord, int x0, int x1, int z0, int z1)
+    {
+        std::vector<JobHandle> running;
+        for (int p = 0; p < 4; p++)
+        {
+            int dx = faceChecks[p][0];
+            int dz = faceChecks[p][2];
+            bool onBorder = (dx > 0 && x1 == chunkWidth - 1) || (dx < 0 && x0 == 0) || (dz > 0 && z1 == chunkWidth - 1) || (dz < 0 && z0 == 0);
+            if (!onBorder)
+                continue;
+
+            auto it = chunks.find(ChunkCoord(coord.x + dx, coord.z + dz));
+            if (it != chunks.end() && it->second != nullptr && !it->second->isReady() && !JobSystem::isDone(it->second->meshJob))
+                running.push_back(it->second->meshJob);
+        }
+
+        return running;
+    }
+
+    void applyDeferredEdits()
+    {
+        std::vector<std::pair<glm::ivec3, int>> edits;
+        edits.swap(deferredEdits);
+
+        // Any still blocked go back on the list, in order
+        for (auto &edit : edits)
+            setVoxel(edit.first.x, edit.first.y, edit.first.z, edit.second);
+    }
+
+    // Stone, or something a lode could have turned stone into
+    bool isOreStageBlock(BlockType &voxel)
+    {
+        if (voxel == blockTypes[3])
+            return true;
+
+        for (const Lode &lode : *lodeSet)
+        {
+            if (voxel == blockTypes[lode.blockID])
+                return true;
+        }
+
+        return false;
+    }
+
+    // Stops pipeline work on coord unless chunks in range around centre, or around the end of the
+    // predicted path, depend on it
+    void cancelIfUnwanted(ChunkCoord coord, ChunkCoord centre)
+    {
+        if (chunkDistance(coord, centre) <= renderDistance + 1 || chunkDistance(coord, prefetchLead) <= renderDistance + 1)
+            return;
+
+        auto it = chunks.find(coord);
+        if (it != chunks.end() && it->second != nullptr && !it->second->isReady())
+            it->second->cancelled = true;
+    }
+
+    // Already meshed, or on its way there and not cancelled
+    bool isMeshPending(ChunkCoord coord)
+    {
+        auto it = chunks.find(coord);
+        if (it == chunks.end() || it->second == nullptr)
+            return false;
+
+        Chunk *chunk = it->second;
+        return chunk->isReady() || (chunk->meshJob && !chunk->cancelled && !JobSystem::isDone(chunk->meshJob));
+    }
+
+    void recordEntry(ChunkCoord coord)
+    {
+        bool ready = isChunkReady(coord);
+        bool wasPrefetched = prefetched.erase(coord) > 0;
+
+        prefetchStats.entered++;
+        prefetchStats.ready += ready;
+        prefetchStats.prefetched += wasPrefetched;
+        prefetchStats.prefetchedReady += wasPrefetched && ready;
+    }
+
+    ChunkCoord predictChunk(glm::vec3 position, glm::vec2 direction, float distance)
+    {
+        glm::vec2 point = glm::vec2(position.x, position.z) + direction * distance;
+        int x = std::min(std::max((int)floor(point.x / chunkWidth), 0), worldWidth - 1);
+        int z = std::min(std::max((int)floor(point.y / chunkWidth), 0), worldWidth - 1);
+        return ChunkCoord(x, z);
+    }
+
+    void recordJobTime(std::chrono::steady_clock::time_point start)
+    {
+        float ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        // Workers race on this; a lost update only costs one sample
+        float average = averageJobMs;
+        averageJobMs = average + (ms - average) * 0.05f;
+    }
+
+    Chunk *getOrCreateChunk(ChunkCoord coord)
+    {
+        Chunk *&chunk = chunks[coord];
+        if (chunk == nullptr)
+            chunk = new Chunk(this, coord);
+        return chunk;
+    }
+
+    // A stage needs a new job unless one is already queued or running, or an earlier one got it done.
+    // A job that finished without reaching its stage was cancelled, so the chunk is started over.
+    bool needsJob(Chunk *chunk, const JobHandle &job, int stage)
+    {
+        if (!job)
+            return true;
+
+        if (JobSystem::isDone(job) && chunk->stage < stage)
+        {
+            chunk->cancelled = false;
+            return true;
+        }
+
+        if (!JobSystem::isDone(job))
+            chunk->cancelled = false;
+
+        return false;
+    }
+
+    // Captures coord and its in-world neighbours, calling visit for each of them (coord included)
+    template <typename Fn>
+    ChunkArea gatherArea(ChunkCoord coord, Fn visit)
+    {
+        ChunkArea area;
+        area.centre = coord;
+
+        for (int dx = -1; dx <= 1; dx++)
+        {
+            for (int dz = -1; dz <= 1; dz++)
+            {
+                ChunkCoord c(coord.x + dx, coord.z + dz);
+                if (c.x < 0 || c.z < 0 || c.x >= worldWidth || c.z >= worldWidth)
+                    continue;
+
+                visit(c);
+                area.chunks[dx + 1][dz + 1] = chunks[c];
+
+                // The job reads this chunk's voxels; it will not be frozen while the job is pending
+                if (chunks[c]->isCold())
+                    touch(chunks[c]);
+            }
+        }
+
+        return area;
     }
 };
@@ -1,9 +1,15 @@
+#include <algorithm>
+#include <cstring>
+
 #include "voxelData.h"
 #include "chunk.h"
 #include "world.h"
+#include "runLength.h"
 
 void Chunk::populateVoxelMap()
 {
+    PROFILE_SCOPE("populate");
+
     voxelMap.resize(chunkWidth);
     for (int x = 0; x < chunkWidth; x++)
     {
@@ -26,11 +32,200 @@ void Chunk::populateVoxelMap()
     }
 }
 
-void Chunk::generateMesh()
+void Chunk::getBlocks(std::vector<uint8_t> &blocks)
+{
+    blocks.resize((size_t)chunkWidth * chunkHeight * chunkWidth);
+
+    size_t i = 0;
+    for (int x = 0; x < chunkWidth; x++)
+        for (int z = 0; z < chunkWidth; z++)
+            for (int y = 0; y < chunkHeight; y++)
+                blocks[i++] = voxelMap[x][y][z].id;
+}
+
+void Chunk::freeze()
+{
+    std::vector<uint8_t> blocks;
+    getBlocks(blocks);
+
+    packed.clear();
+    encodeRuns(blocks.data(), blocks.size(), packed);
+    packed.shrink_to_fit();
+
+    std::vector<std::vector<std::vector<BlockType>>>().swap(voxelMap);
+}
+
+void Chunk::thaw()
+{
+    std::vector<uint8_t> blocks((size_t)chunkWidth * chunkHeight * chunkWidth);
+    decodeRuns(packed.data(), packed.size(), blocks.data(), blocks.size());
+    std::vector<uint8_t>().swap(packed);
+
+    setBlocks(blocks.data());
+}
+
+void Chunk::setBlocks(const uint8_t *blocks)
+{
+    voxelMap.assign(chunkWidth, std::vector<std::vector<BlockType>>(chunkHeight, std::vector<BlockType>(chunkWidth)));
+
+    size_t i = 0;
+    for (int x = 0; x < chunkWidth; x++)
+        for (int z = 0; z < chunkWidth; z++)
+            for (int y = 0; y < chunkHeight; y++)
+                voxelMap[x][y][z] = blockTypes[blocks[i++]];
+}
+
+size_t Chunk::expandedBytes()
+{
+    size_t perVoxel = sizeof(BlockType) + blockTypes[0].textures.size() * sizeof(unsigned int);
+    size_t rows = (size_t)chunkWidth * chunkHeight * sizeof(std::vector<BlockType>) + chunkWidth * sizeof(std::vector<std::vector<BlockType>>);
+    return (size_t)chunkWidth * chunkHeight * chunkWidth * perVoxel + rows;
+}
+
+ChunkMemory Chunk::memoryUsage()
+{
+    ChunkMemory memory;
+    memory.object = sizeof(Chunk) + sections.capacity() * sizeof(ChunkSection);
+
+    if (stage >= STAGE_GENERATED)
+    {
+        memory.voxels = isCold() ? packed.capacity() : expandedBytes();
+        memory.edits = hashContainerBytes(edits, sizeof(std::pair<const int, uint8_t>));
+    }
+
+    std::lock_guard<std::mutex> lock(meshMutex);
+    for (const ChunkSection &section : sections)
+        memory.vertices += section.vertices.capacity() * sizeof(float);
+
+    return memory;
+}
+
+namespace
+{
+    void writeVarint(std::vector<uint8_t> &out, uint32_t value)
+    {
+        while (value >= 0x80)
+        {
+            out.push_back((uint8_t)(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back((uint8_t)value);
+    }
+
+    bool readVarint(const std::vector<uint8_t> &in, size_t &pos, uint32_t &value)
+    {
+        value = 0;
+        for (int shift = 0; shift <= 28; shift += 7)
+        {
+            if (pos >= in.size())
+                return false;
+
+            uint8_t byte = in[pos++];
+            value |= (uint32_t)(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0)
+                return true;
+        }
+        return false;
+    }
+}
+
+void Chunk::writeEdits(std::vector<uint8_t> &payload)
 {
+    std::vector<std::pair<int, uint8_t>> sorted(edits.begin(), edits.end());
+    std::sort(sorted.begin(), sorted.end());
+
+    payload.clear();
+    payload.push_back(PAYLOAD_EDITS);
+    writeVarint(payload, (uint32_t)sorted.size());
+
+    int previous = 0;
+    for (const auto &edit : sorted)
+    {
+        writeVarint(payload, (uint32_t)(edit.first - previous));
+        payload.push_back(edit.second);
+        previous = edit.first;
+    }
+}
+
+void Chunk::writeWhole(std::vector<uint8_t> &payload)
+{
+    writeEdits(payload);
+    payload[0] = PAYLOAD_WHOLE;
+
+    std::vector<uint8_t> blocks;
+    getBlocks(blocks);
+    encodeRuns(blocks.data(), blocks.size(), payload);
+}
+
+bool Chunk::readPayload(const std::vector<uint8_t> &payload)
+{
+    if (payload.empty() || payload[0] > PAYLOAD_WHOLE)
+        return false;
+
+    size_t pos = 1;
+    uint32_t count;
+    if (!readVarint(payload, pos, count))
+        return false;
+
+    int voxels = chunkWidth * chunkHeight * chunkWidth;
+    std::vector<std::pair<int, uint8_t>> read;
+    int index = 0;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        uint32_t gap;
+        if (!readVarint(payload, pos, gap) || pos >= payload.size())
+            return false;
+
+        index += (int)gap;
+        uint8_t block = payload[pos++];
+        if (index >= voxels || block >= blockTypeCount)
+            return false;
+
+        read.emplace_back(index, block);
+    }
+
+    if (isWholePayload(payload))
+    {
+        std::vector<uint8_t> blocks(voxels);
+        if (!decodeRuns(payload.data() + pos, payload.size() - pos, blocks.data(), blocks.size()))
+            return false;
+
+        for (uint8_t block : blocks)
+            if (block >= blockTypeCount)
+                return false;
+
+        setBlocks(blocks.data());
+    }
+
+    for (const auto &edit : read)
+    {
+        edits[edit.first] = edit.second;
+
+        int y = edit.first % chunkHeight;
+        int z = edit.first / chunkHeight % chunkWidth;
+        int x = edit.first / chunkHeight / chunkWidth;
+        voxelMap[x][y][z] = blockTypes[edit.second];
+    }
+
+    return true;
+}
+
+void Chunk::generateMesh(Chunk *const neighbours[4])
+{
+    PROFILE_SCOPE("generateMesh");
+
+    for (int s = 0; s < (int)sections.size(); s++)
+        generateSectionMesh(s, neighbours);
+}
+
+void Chunk::generateSectionMesh(int s, Chunk *const neighbours[4])
+{
+    // Built into a per-thread scratch buffer so the render thread is only locked out for the copy
+    thread_local std::vector<float> vertices;
+
     vertices.clear();
-    vertices.reserve(chunkWidth * chunkHeight * chunkWidth * 6 * 48); // Estimate max size
-    for (int y = 0; y < chunkHeight; y++)
+    vertices.reserve(chunkWidth * sectionHeight * chunkWidth * 6 * 48); // Estimate max size
+    for (int y = s * sectionHeight; y < (s + 1) * sectionHeight; y++)
     {
         bool layerHasBlocks = false;
         for (int x = 0; x < chunkWidth && !layerHasBlocks; x++)
@@ -55,7 +250,17 @@ void Chunk::generateMesh()
                     int ny = y + faceChecks[p][1];
                     int nz = z + faceChecks[p][2];
 
-                    const BlockType &nBlock = world->getVoxel(coord, nx, ny, nz);
+                    // Looked up directly rather than through World so meshing never touches the chunk map
+                    const BlockType *neighbour = &blockTypes[0]; // Air above, below and past the world edge
+                    if (ny >= 0 && ny < chunkHeight)
+                    {
+                        if (nx >= 0 && nx < chunkWidth && nz >= 0 && nz < chunkWidth)
+                            neighbour = &voxelMap[nx][ny][nz];
+                        else if (neighbours[p] != nullptr)
+                            neighbour = &neighbours[p]->voxelMap[(nx + chunkWidth) % chunkWidth][ny][(nz + chunkWidth) % chunkWidth];
+                    }
+
+                    const BlockType &nBlock = *neighbour;
 
                     if (nBlock.isAir || nBlock.isTransparent)
                     {
@@ -79,8 +284,11 @@ void Chunk::generateMesh()
                             vertices.push_back(cubeVertices[offset + i + 6]);
                             vertices.push_back(cubeVertices[offset + i + 7]);
 
+                            // The texture id's bits, read back as an int by the vertex shader
                             int tid = block.textures[p];
-                            vertices.push_back(*(float *)&tid);
+                            float tidBits;
+                            memcpy(&tidBits, &tid, sizeof(tidBits));
+                            vertices.push_back(tidBits);
                         }
                     }
                     else
@@ -93,38 +301,17 @@ void Chunk::generateMesh()
         }
     }
 
-    vertexCount = vertices.size() / 9;
-
-    if (VAO == 0)
     {
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
+        std::lock_guard<std::mutex> lock(meshMutex);
+        sections[s].vertices.assign(vertices.begin(), vertices.end());
+        sections[s].needsUpload = true;
+        meshReady = true;
     }
-    glBindVertexArray(VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
-
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(float) * 9, (void *)0);
-    glEnableVertexAttribArray(0);
-
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(float) * 9, (void *)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
-
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(float) * 9, (void *)(6 * sizeof(float)));
-    glEnableVertexAttribArray(2);
-
-    glVertexAttribIPointer(3, 1, GL_INT, sizeof(float) * 9, (void *)(8 * sizeof(float)));
-    glEnableVertexAttribArray(3);
-
-    glBindVertexArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-    shouldRegen = false;
 }
 
 void Chunk::setVoxel(int localX, int localY, int localZ, unsigned int block)
 {
     voxelMap[localX][localY][localZ] = blockTypes[block];
-    world->regenerateChunks(coord, localX, localZ);
+    recordEdit(localX, localY, localZ, (uint8_t)block);
+    world->markChunksDirty(coord, localX, localZ, localY, localY);
 }
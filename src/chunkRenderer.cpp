@@ -0,0 +1,118 @@
+#include "chunkRenderer.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "profiler.h"
+
+ChunkRenderer::~ChunkRenderer()
+{
+    for (auto &pair : meshes)
+    {
+        for (SectionBuffers &buffers : pair.second)
+        {
+            if (buffers.VAO != 0)
+            {
+                glDeleteBuffers(1, &buffers.VBO);
+                glDeleteVertexArrays(1, &buffers.VAO);
+            }
+        }
+    }
+}
+
+bool ChunkRenderer::uploadNextSection(Chunk *chunk)
+{
+    if (!chunk->meshReady)
+        return false;
+
+    PROFILE_SCOPE("upload");
+    std::lock_guard<std::mutex> lock(chunk->meshMutex);
+
+    std::vector<SectionBuffers> &mesh = meshes[chunk];
+    mesh.resize(chunk->sections.size());
+
+    for (size_t s = 0; s < chunk->sections.size(); s++)
+    {
+        ChunkSection &section = chunk->sections[s];
+        if (!section.needsUpload)
+            continue;
+
+        SectionBuffers &buffers = mesh[s];
+        section.needsUpload = false;
+        bufferBytes -= buffers.vertexCount * 9 * sizeof(float);
+        buffers.vertexCount = section.vertices.size() / 9;
+        bufferBytes += buffers.vertexCount * 9 * sizeof(float);
+
+        if (buffers.VAO == 0)
+        {
+            glGenVertexArrays(1, &buffers.VAO);
+            glGenBuffers(1, &buffers.VBO);
+        }
+        glBindVertexArray(buffers.VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, buffers.VBO);
+
+        glBufferData(GL_ARRAY_BUFFER, section.vertices.size() * sizeof(float), section.vertices.data(), GL_STATIC_DRAW);
+
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(float) * 9, (void *)0);
+        glEnableVertexAttribArray(0);
+
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(float) * 9, (void *)(3 * sizeof(float)));
+        glEnableVertexAttribArray(1);
+
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(float) * 9, (void *)(6 * sizeof(float)));
+        glEnableVertexAttribArray(2);
+
+        glVertexAttribIPointer(3, 1, GL_INT, sizeof(float) * 9, (void *)(8 * sizeof(float)));
+        glEnableVertexAttribArray(3);
+
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        return true;
+    }
+
+    // Cleared under the lock, so a section meshed after the scan above sets it again
+    chunk->meshReady = false;
+    return false;
+}
+
+void ChunkRenderer::render(Chunk *chunk, Shader *shader, const glm::mat4 &view, const glm::mat4 &projection)
+{
+    auto it = meshes.find(chunk);
+    if (it == meshes.end())
+        return;
+
+    glm::mat4 model = glm::mat4(1.0f);
+    model = glm::translate(model, glm::vec3(chunk->coord.x * chunkWidth, 0.0f, chunk->coord.z * chunkWidth));
+
+    shader->use();
+    shader->setMat4("model", model);
+    shader->setMat4("view", view);
+    shader->setMat4("projection", projection);
+
+    for (const SectionBuffers &buffers : it->second)
+    {
+        if (buffers.vertexCount == 0)
+            continue;
+
+        glBindVertexArray(buffers.VAO);
+        glDrawArrays(GL_TRIANGLES, 0, buffers.vertexCount);
+    }
+    glBindVertexArray(0);
+}
+
+void ChunkRenderer::release(Chunk *chunk)
+{
+    auto it = meshes.find(chunk);
+    if (it == meshes.end())
+        return;
+
+    for (SectionBuffers &buffers : it->second)
+    {
+        if (buffers.VAO != 0)
+        {
+            glDeleteBuffers(1, &buffers.VBO);
+            glDeleteVertexArrays(1, &buffers.VAO);
+        }
+        bufferBytes -= buffers.vertexCount * 9 * sizeof(float);
+    }
+    meshes.erase(it);
+}
@@ -0,0 +1,273 @@
+#include <cstring>
+
+#include "horizon.h"
+#include "noise.h"
+#include "profiler.h"
+
+void Horizon::update(ChunkCoord centre, int rd)
+{
+    if (!useHorizon)
+    {
+        if (lastEnabled)
+        {
+            for (auto &pair : tiles)
+                delete pair.second;
+            tiles.clear();
+            tilesToBuild = std::queue<ChunkCoord>();
+            tilesInQueue.clear();
+        }
+        lastEnabled = false;
+        return;
+    }
+
+    if (lastEnabled && centre == lastCentre && rd == lastRD && horizonScale == lastScale)
+        return;
+
+    int radius = rd * horizonScale;
+
+    int minTileX = std::max(centre.x - radius, 0) / horizonTileChunks;
+    int minTileZ = std::max(centre.z - radius, 0) / horizonTileChunks;
+    int maxTileX = std::min(centre.x + radius, worldWidth - 1) / horizonTileChunks;
+    int maxTileZ = std::min(centre.z + radius, worldWidth - 1) / horizonTileChunks;
+
+    // Drop tiles that left the horizon radius
+    for (auto it = tiles.begin(); it != tiles.end();)
+    {
+        ChunkCoord tile = it->first;
+        if (tile.x < minTileX || tile.x > maxTileX || tile.z < minTileZ || tile.z > maxTileZ)
+        {
+            delete it->second;
+            it = tiles.erase(it);
+        }
+        else
+            it++;
+    }
+
+    for (int tx = minTileX; tx <= maxTileX; tx++)
+    {
+        for (int tz = minTileZ; tz <= maxTileZ; tz++)
+        {
+            ChunkCoord tile(tx, tz);
+
+            if (tiles.find(tile) == tiles.end())
+            {
+                tiles[tile] = new HorizonTile(tile);
+                queueTile(tile);
+            }
+            else if (tileOverlapsChunks(tile, lastCentre, lastRD) || tileOverlapsChunks(tile, centre, rd))
+            {
+                // The chunk area moved across this tile, so its cut-out has to follow
+                queueTile(tile);
+            }
+        }
+    }
+
+    lastCentre = centre;
+    lastRD = rd;
+    lastScale = horizonScale;
+    lastEnabled = true;
+}
+
+bool Horizon::buildNextTile()
+{
+    while (!tilesToBuild.empty())
+    {
+        ChunkCoord next = tilesToBuild.front();
+        tilesToBuild.pop();
+        tilesInQueue.erase(next);
+
+        auto it = tiles.find(next);
+        if (it != tiles.end() && it->second != nullptr)
+        {
+            PROFILE_SCOPE("horizon tile");
+            buildTile(it->second);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+size_t Horizon::cpuBytes() const
+{
+    size_t bytes = hashContainerBytes(tiles, sizeof(std::pair<const ChunkCoord, HorizonTile *>));
+    for (auto &pair : tiles)
+        bytes += sizeof(HorizonTile) + pair.second->vertices.capacity() * sizeof(float);
+    return bytes;
+}
+
+size_t Horizon::gpuBytes() const
+{
+    size_t bytes = 0;
+    for (auto &pair : tiles)
+        bytes += pair.second->vertexCount * 9 * sizeof(float);
+    return bytes;
+}
+
+void Horizon::render(Shader *shader, const glm::mat4 &view, const glm::mat4 &projection)
+{
+    if (!useHorizon)
+        return;
+
+    shader->use();
+    shader->setMat4("view", view);
+    shader->setMat4("projection", projection);
+
+    for (auto &pair : tiles)
+    {
+        HorizonTile *tile = pair.second;
+        if (tile->vertexCount == 0)
+            continue;
+
+        glm::mat4 model = glm::mat4(1.0f);
+        model = glm::translate(model, glm::vec3(tile->coord.x * horizonTileChunks * chunkWidth, 0.0f, tile->coord.z * horizonTileChunks * chunkWidth));
+        shader->setMat4("model", model);
+
+        glBindVertexArray(tile->VAO);
+        glDrawArrays(GL_TRIANGLES, 0, tile->vertexCount);
+    }
+
+    glBindVertexArray(0);
+}
+
+void Horizon::queueTile(ChunkCoord tile)
+{
+    if (tilesInQueue.find(tile) != tilesInQueue.end())
+        return;
+
+    tilesToBuild.push(tile);
+    tilesInQueue.insert(tile);
+}
+
+bool Horizon::tileOverlapsChunks(ChunkCoord tile, ChunkCoord centre, int rd)
+{
+    if (rd < 0)
+        return false;
+
+    int minX = tile.x * horizonTileChunks;
+    int minZ = tile.z * horizonTileChunks;
+    int maxX = minX + horizonTileChunks - 1;
+    int maxZ = minZ + horizonTileChunks - 1;
+
+    // Matches the square drawn by the chunk render loop: [centre - rd, centre + rd)
+    return maxX >= centre.x - rd && minX < centre.x + rd && maxZ >= centre.z - rd && minZ < centre.z + rd;
+}
+
+bool Horizon::isChunkRendered(int chunkX, int chunkZ)
+{
+    return chunkX >= lastCentre.x - lastRD && chunkX < lastCentre.x + lastRD &&
+           chunkZ >= lastCentre.z - lastRD && chunkZ < lastCentre.z + lastRD;
+}
+
+void Horizon::buildTile(HorizonTile *tile)
+{
+    int tileWidth = horizonTileChunks * chunkWidth;
+    int cells = tileWidth / horizonStep;
+    int samples = cells + 1;
+
+    int originX = tile->coord.x * tileWidth;
+    int originZ = tile->coord.z * tileWidth;
+
+    // Sample one ring outside the tile so edge normals match the neighbouring tile
+    std::vector<float> heights((samples + 2) * (samples + 2));
+    std::vector<int> textures(samples * samples);
+
+    for (int i = -1; i <= samples; i++)
+    {
+        for (int j = -1; j <= samples; j++)
+        {
+            int terrain = getTerrainHeight(originX + i * horizonStep, originZ + j * horizonStep);
+            int surface = std::max(terrain, waterHeight - 1);
+            heights[(i + 1) * (samples + 2) + (j + 1)] = surface + 0.5f;
+
+            if (i >= 0 && j >= 0 && i < samples && j < samples)
+                textures[i * samples + j] = terrain < waterHeight ? blockTypes[7].textures[4] : blockTypes[1].textures[4];
+        }
+    }
+
+    auto height = [&](int i, int j)
+    { return heights[(i + 1) * (samples + 2) + (j + 1)]; };
+
+    auto pushVertex = [&](int i, int j, int tid, float u, float v)
+    {
+        glm::vec3 normal = glm::normalize(glm::vec3(height(i - 1, j) - height(i + 1, j), 2.0f * horizonStep, height(i, j - 1) - height(i, j + 1)));
+
+        tile->vertices.push_back(i * horizonStep - 0.5f);
+        tile->vertices.push_back(height(i, j));
+        tile->vertices.push_back(j * horizonStep - 0.5f);
+
+        tile->vertices.push_back(normal.x);
+        tile->vertices.push_back(normal.y);
+        tile->vertices.push_back(normal.z);
+
+        tile->vertices.push_back(u);
+        tile->vertices.push_back(v);
+
+        // The texture id's bits, read back as an int by the vertex shader
+        float tidBits;
+        memcpy(&tidBits, &tid, sizeof(tidBits));
+        tile->vertices.push_back(tidBits);
+    };
+
+    tile->vertices.clear();
+    tile->vertices.reserve(cells * cells * 6 * 9);
+
+    for (int i = 0; i < cells; i++)
+    {
+        int chunkX = (originX + i * horizonStep) / chunkWidth;
+        if (chunkX >= worldWidth)
+            break;
+
+        for (int j = 0; j < cells; j++)
+        {
+            int chunkZ = (originZ + j * horizonStep) / chunkWidth;
+            if (chunkZ >= worldWidth)
+                break;
+
+            // Real chunks are drawn here
+            if (isChunkRendered(chunkX, chunkZ))
+                continue;
+
+            int tid = textures[i * samples + j];
+
+            // Same winding as the top face in cubeVertices
+            pushVertex(i, j, tid, 0.0f, 0.0f);
+            pushVertex(i, j + 1, tid, 0.0f, 1.0f);
+            pushVertex(i + 1, j + 1, tid, 1.0f, 1.0f);
+            pushVertex(i + 1, j + 1, tid, 1.0f, 1.0f);
+            pushVertex(i + 1, j, tid, 1.0f, 0.0f);
+            pushVertex(i, j, tid, 0.0f, 0.0f);
+        }
+    }
+
+    tile->vertexCount = tile->vertices.size() / 9;
+
+    if (tile->VAO == 0)
+    {
+        glGenVertexArrays(1, &tile->VAO);
+        glGenBuffers(1, &tile->VBO);
+    }
+    glBindVertexArray(tile->VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, tile->VBO);
+
+    glBufferData(GL_ARRAY_BUFFER, tile->vertices.size() * sizeof(float), tile->vertices.data(), GL_STATIC_DRAW);
+
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(float) * 9, (void *)0);
+    glEnableVertexAttribArray(0);
+
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(float) * 9, (void *)(3 * sizeof(float)));
+    glEnableVertexAttribArray(1);
+
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(float) * 9, (void *)(6 * sizeof(float)));
+    glEnableVertexAttribArray(2);
+
+    glVertexAttribIPointer(3, 1, GL_INT, sizeof(float) * 9, (void *)(8 * sizeof(float)));
+    glEnableVertexAttribArray(3);
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    // The GPU copy is all that is drawn
+    tile->vertices.clear();
+    tile->vertices.shrink_to_fit();
+}
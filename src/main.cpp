@@ -1,6 +1,14 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include <iostream>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <cstdio>
+#include <ctime>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
@@ -10,9 +18,15 @@
 
 #include "voxelData.h"
 #include "world.h"
+#include "horizon.h"
+#include "chunkRenderer.h"
 #include "shader.h"
 #include "camera.h"
 #include "player.h"
+#include "entities.h"
+#include "snapshot.h"
+#include "profiler.h"
+#include "hitchDetector.h"
 
 class Engine
 {
@@ -20,7 +34,10 @@ public:
     Shader *shader;
     Shader *outlineShader;
     World *world;
+    Horizon *horizon;
+    ChunkRenderer *chunkRenderer;
     Player *player;
+    EntityStore *entities;
 
     GLFWwindow *window;
 
@@ -71,13 +88,22 @@ public:
         shader->setInt("atlasSampler", 0);
 
         world = new World();
+        world->regions = std::make_unique<RegionStore>(saveDirectory);
         player = new Player(world, new Camera(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 1.0f, 0.0f)), SURVIVAL);
+        entities = new EntityStore();
 
         lastFrame = 0.0f;
         dt = 0.0f;
 
         int worldCentre = floor(worldWidth / 2);
+        world->refocus(ChunkCoord(worldCentre, worldCentre), player->lookForward);
         world->updateRenderDistance(ChunkCoord(worldCentre, worldCentre));
+
+        horizon = new Horizon();
+        chunkRenderer = new ChunkRenderer();
+        horizon->update(ChunkCoord(worldCentre, worldCentre), renderDistance);
+        renderDistanceSetting = renderDistance;
+        lodeSettings.assign(lodes, lodes + lodeCount);
     }
 
     ~Engine()
@@ -87,97 +113,117 @@ public:
 
     void run()
     {
+        simThread = std::thread(&Engine::simulationLoop, this);
+        PROFILE_THREAD("render");
+
         glm::vec3 skyColour = glm::vec3(0.6f, 0.95f, 1.0f);
         glm::vec3 waterSkyColour = glm::vec3(29.0f/255.0f, 86.0f/255.0f, 191.0f/255.0f);
         while (!glfwWindowShouldClose(window) && shouldRun)
         {
-            if(!player->isHeadInWater()) glClearColor(skyColour.r, skyColour.g, skyColour.b, 1.0f);
+            if (snapshots.acquire(frame))
+            {
+                PROFILE_SCOPE("retire chunks");
+
+                // Nothing in this snapshot refers to these any more
+                for (Chunk *chunk : frame.retiredChunks)
+                {
+                    chunkRenderer->release(chunk);
+                    delete chunk;
+                }
+                frame.retiredChunks.clear();
+            }
+
+            if(!frame.headInWater) glClearColor(skyColour.r, skyColour.g, skyColour.b, 1.0f);
             else glClearColor(waterSkyColour.r, waterSkyColour.g, waterSkyColour.b, 1.0f);
             glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
             calculateDeltaTime();
 
-            processInput(window, dt);
+            {
+                PROFILE_SCOPE("input");
+                processInput(window, dt);
+
+                if (!paused)
+                {
+                    player->processLook(window, dt);
+                    sampleInput();
+                }
+            }
+
+            // Draw between the snapshot's last two tick positions
+            float tickAlpha = glm::clamp((float)((glfwGetTime() - frame.tickTime) * tickRate), 0.0f, 1.0f);
+            player->placeCamera(frame.previousPosition, frame.position, tickAlpha);
+            player->camera->updateFOV(frame.sprinting);
 
             glm::mat4 view = player->camera->GetViewMatrix();
             glm::mat4 projection = player->camera->GetProjectionMatrix();
 
-            if (!paused)
             {
-                player->processInput(window, dt);
-                player->updatePhysics(dt);
-                player->updateCoord();
+                PROFILE_SCOPE("horizon update");
+                horizon->update(frame.playerCoord, frame.renderDistance);
+            }
 
-                if (player->gamemode == CREATIVE || player->gamemode == SURVIVAL)
-                    player->checkBlock();
+            streamToGPU();
 
-                if ((!(player->lastCoord == player->coord) && useRD) || player->checkRD())
-                    world->updateRenderDistance(player->coord);
+            {
+                PROFILE_SCOPE("render");
+                horizon->render(shader, view, projection);
 
-                int chunksPerFrame = 2;
-                for (int i = 0; i < chunksPerFrame && !world->chunksToGenerate.empty(); i++)
-                {
-                    ChunkCoord next = world->chunksToGenerate.front();
-                    world->chunksToGenerate.pop();
-                    world->chunksInQueue.erase(next);
-
-                    auto it = world->chunks.find(next);
-                    if (it != world->chunks.end() && it->second != nullptr && it->second->shouldRegen)
-                    {
-                        it->second->generateMesh();
-                    }
-                }
-            }
+                for (Chunk *chunk : frame.visibleChunks)
+                    chunkRenderer->render(chunk, shader, view, projection);
 
-            for (int x = player->coord.x - renderDistance; x < player->coord.x + renderDistance; x++)
-            {
-                for (int z = player->coord.z - renderDistance; z < player->coord.z + renderDistance; z++)
+                if (!frame.entityPositions.empty())
+                    renderEntities(view, projection, tickAlpha);
+
+                if(frame.gamemode != SPECTATOR && frame.target.hit)
                 {
-                    ChunkCoord coord(x, z);
-                    auto it = world->chunks.find(coord);
-                    if (it != world->chunks.end() && it->second != nullptr)
-                    {
-                        it->second->renderChunk(shader, view, projection);
-                    }
+                    glm::vec3 blockPos = glm::vec3(frame.target.block);
+                    glm::mat4 model = glm::mat4(1.0f);
+                    model = glm::translate(model, blockPos);
+
+                    outlineShader->use();
+                    outlineShader->setMat4("model", model);
+                    outlineShader->setMat4("view", view);
+                    outlineShader->setMat4("projection", projection);
+                    outlineShader->setFloat("lineWidth", 3.0f);
+                    outlineShader->setVec3("outlineColor", glm::vec3(0.0f, 0.0f, 0.0f));
+
+                    glDisable(GL_DEPTH_TEST);
+                    glBindVertexArray(outlineVAO);
+                    glCullFace(GL_FRONT);
+                    glDrawArrays(GL_LINES, 0, 24);
+                    glCullFace(GL_BACK);
+                    glEnable(GL_DEPTH_TEST);
                 }
             }
 
-            player->lastCoord = player->coord;
-
-            if(player->gamemode != SPECTATOR)
             {
-                glm::vec3 blockPos = player->getViewBlock();
-                glm::mat4 model = glm::mat4(1.0f);
-                model = glm::translate(model, blockPos);
-
-                outlineShader->use();
-                outlineShader->setMat4("model", model);
-                outlineShader->setMat4("view", view);
-                outlineShader->setMat4("projection", projection);
-                outlineShader->setFloat("lineWidth", 3.0f);
-                outlineShader->setVec3("outlineColor", glm::vec3(0.0f, 0.0f, 0.0f));
-
-                glDisable(GL_DEPTH_TEST);
-                glBindVertexArray(outlineVAO);
-                glCullFace(GL_FRONT);
-                glDrawArrays(GL_LINES, 0, 24);
-                glCullFace(GL_BACK);
-                glEnable(GL_DEPTH_TEST);
-            }
+                PROFILE_SCOPE("imgui");
+                ImGui_ImplOpenGL3_NewFrame();
+                ImGui_ImplGlfw_NewFrame();
+                ImGui::NewFrame();
 
-            ImGui_ImplOpenGL3_NewFrame();
-            ImGui_ImplGlfw_NewFrame();
-            ImGui::NewFrame();
+                drawCrosshair();
+                drawUI();
 
-            drawCrosshair();
-            drawUI();
+                ImGui::Render();
+                ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+            }
 
-            ImGui::Render();
-            ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+            {
+                // Includes waiting for vsync
+                PROFILE_SCOPE("swap");
+                glfwSwapBuffers(window);
+                glfwPollEvents();
+            }
 
-            glfwSwapBuffers(window);
-            glfwPollEvents();
+            const ProfileFrame &closed = profiler.markFrame();
+            if (hitchCapture && hitchDetector.addFrame(closed.ms()))
+                captureHitch(closed);
         }
+
+        simRunning = false;
+        simThread.join();
     }
 
 private:
@@ -187,18 +233,314 @@ private:
     float lastFrame;
     float dt;
 
+    float tickRate = 60.0f;
+    int maxCatchUpTicks = 5;
+    float tickBudgetShare = 0.25f; // Share of each tick spent remeshing edited chunks
+
+    FrameBudget frameBudget; // Render thread
+    FrameBudget tickBudget;  // Simulation thread
+
+    int traceSeconds = 5; // Length of a trace recorded from the profiler panel
+
+    HitchDetector hitchDetector; // Render thread
+    bool hitchCapture = true;
+    float hitchSeconds = 3.0f; // Profiler history written out with each hitch
+    std::string lastHitchPath;
+
     bool shouldRun = true;
     bool pauseClicked = false;
     bool paused = false;
 
+    // Simulation thread: owns World, Player (except its camera) and EntityStore once run() starts
+    std::thread simThread;
+    std::atomic<bool> simRunning{true};
+    std::atomic<bool> simPaused{false};
+    RenderSnapshot simFrame;
+    MemoryStats simMemory; // Last measurement, published with every snapshot until the next one
+    double lastMemoryMeasure = -1.0;
+    float memoryMeasureInterval = 0.25f; // Seconds; measuring walks every chunk, so not every tick
+
+    // Render thread -> simulation thread
+    std::mutex inputMutex;
+    InputState pendingInput;
+    std::mutex commandMutex;
+    std::vector<std::function<void()>> commands;
+
+    // Simulation thread -> render thread
+    SnapshotBuffer snapshots;
+    RenderSnapshot frame;
+    // UI copies of settings the simulation owns; edits are posted across rather than written in place
+    int renderDistanceSetting;
+    std::vector<Lode> lodeSettings;
+
+    // Queues work that touches simulation state (UI edits) to run at the start of the next tick
+    void postToSimulation(std::function<void()> command)
+    {
+        std::lock_guard<std::mutex> lock(commandMutex);
+        commands.push_back(std::move(command));
+    }
+
+    bool runCommands()
+    {
+        std::vector<std::function<void()>> pending;
+        {
+            std::lock_guard<std::mutex> lock(commandMutex);
+            pending.swap(commands);
+        }
+
+        for (auto &command : pending)
+            command();
+
+        return !pending.empty();
+    }
+
+    void simulationLoop()
+    {
+        PROFILE_THREAD("simulation");
+
+        double tickDt = 1.0 / tickRate;
+        double accumulator = 0.0;
+        double last = glfwGetTime();
+
+        while (simRunning)
+        {
+            double now = glfwGetTime();
+            accumulator += now - last;
+            last = now;
+
+            bool changed = runCommands();
+
+            if (simPaused)
+            {
+                accumulator = 0.0;
+            }
+            else
+            {
+                // Fixed rate, catching up on at most maxCatchUpTicks at once
+                int ticks = 0;
+                while (accumulator >= tickDt && ticks < maxCatchUpTicks)
+                {
+                    tick((float)tickDt);
+                    accumulator -= tickDt;
+                    ticks++;
+                }
+
+                // A long stall is dropped rather than replayed as a burst of ticks
+                if (accumulator >= tickDt)
+                    accumulator = fmod(accumulator, tickDt);
+
+                simFrame.ticks = ticks;
+                changed = changed || ticks > 0;
+            }
+
+            if (changed)
+                publishSnapshot((float)((glfwGetTime() - now) * 1000.0));
+
+            std::this_thread::sleep_for(std::chrono::duration<double>(std::max(0.0, tickDt - accumulator - (glfwGetTime() - last))));
+        }
+    }
+
+    void publishSnapshot(float tickMs)
+    {
+        PROFILE_SCOPE("publishSnapshot");
+
+        RenderSnapshot &snap = simFrame;
+
+        snap.visibleChunks.clear();
+        for (int x = player->coord.x - renderDistance; x < player->coord.x + renderDistance; x++)
+        {
+            for (int z = player->coord.z - renderDistance; z < player->coord.z + renderDistance; z++)
+            {
+                auto it = world->chunks.find(ChunkCoord(x, z));
+                if (it != world->chunks.end() && it->second != nullptr)
+                    snap.visibleChunks.push_back(it->second);
+            }
+        }
+
+        snap.retiredChunks.swap(world->retiredChunks);
+        world->retiredChunks.clear();
+
+        snap.playerCoord = player->coord;
+        snap.previousPosition = player->previousPosition;
+        snap.position = player->position;
+        snap.gamemode = player->gamemode;
+        snap.sprinting = player->isSprinting;
+        snap.headInWater = player->isHeadInWater();
+        snap.target = player->target;
+
+        snap.entityPrevious.clear();
+        snap.entityPositions.clear();
+        snap.entitySizes.clear();
+        for (size_t i = 0; i < entities->count(); i++)
+        {
+            snap.entityPrevious.push_back(glm::vec3(entities->prevX[i], entities->prevY[i], entities->prevZ[i]));
+            snap.entityPositions.push_back(glm::vec3(entities->posX[i], entities->posY[i], entities->posZ[i]));
+            snap.entitySizes.push_back(glm::vec2(entities->halfWidth[i] * 2.0f, entities->height[i]));
+        }
+
+        snap.renderDistance = renderDistance;
+        snap.chunksLoaded = world->chunks.size();
+        snap.chunksQueued = world->chunksToGenerate.size();
+        snap.chunksPrefetchQueued = world->chunksToPrefetch.size();
+        snap.jobsPending = world->jobs.pending();
+        snap.jobMs = world->averageJobMs;
+        snap.tickBudget = tickBudget;
+        snap.prefetch = world->prefetchStats;
+        snap.cold = world->coldStats;
+        snap.regionLoads = world->regions->chunksLoaded;
+        snap.regionWrites = world->regions->chunksWritten;
+        snap.regionPending = world->regions->pendingWrites();
+        snap.regionBytes = world->regions->bytesWritten;
+        snap.tickTime = glfwGetTime();
+        if (snap.tickTime - lastMemoryMeasure >= memoryMeasureInterval)
+        {
+            world->measureMemory(simMemory);
+            lastMemoryMeasure = snap.tickTime;
+        }
+        snap.memory = simMemory;
+        snap.tickMs = tickMs;
+
+        snapshots.publish(snap);
+    }
+
+    // Render thread: section uploads, nearest chunk first, then horizon tiles, until the frame budget is spent
+    void streamToGPU()
+    {
+        PROFILE_SCOPE("streamToGPU");
+
+        frameBudget.begin(1000.0f / targetFPS * frameBudgetShare);
+
+        std::vector<Chunk *> uploads;
+        for (Chunk *chunk : frame.visibleChunks)
+        {
+            if (chunk->meshReady)
+                uploads.push_back(chunk);
+        }
+
+        ChunkCoord centre = frame.playerCoord;
+        std::sort(uploads.begin(), uploads.end(), [&](Chunk *a, Chunk *b)
+                  { return World::chunkDistance(a->coord, centre) < World::chunkDistance(b->coord, centre); });
+
+        for (Chunk *chunk : uploads)
+        {
+            while (frameBudget.canAfford(WORK_UPLOAD))
+            {
+                if (!frameBudget.run(WORK_UPLOAD, [&]()
+                                     { return chunkRenderer->uploadNextSection(chunk); }))
+                    break;
+            }
+        }
+
+        while (frameBudget.canAfford(WORK_HORIZON))
+        {
+            if (!frameBudget.run(WORK_HORIZON, [&]()
+                                 { return horizon->buildNextTile(); }))
+                break;
+        }
+    }
+
+    // Render thread: GLFW input may only be read here, so it is latched for the next tick
+    void sampleInput()
+    {
+        std::lock_guard<std::mutex> lock(inputMutex);
+
+        bool left = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS;
+        bool right = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_RIGHT) == GLFW_PRESS;
+
+        if (left && !pendingInput.leftMouse)
+            pendingInput.leftClick = true;
+        if (right && !pendingInput.rightMouse)
+            pendingInput.rightClick = true;
+
+        pendingInput.leftMouse = left;
+        pendingInput.rightMouse = right;
+
+        pendingInput.forward = glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS;
+        pendingInput.back = glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS;
+        pendingInput.left = glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS;
+        pendingInput.right = glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS;
+        pendingInput.jump = glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS;
+        pendingInput.shift = glfwGetKey(window, GLFW_KEY_LEFT_SHIFT) == GLFW_PRESS;
+
+        pendingInput.lookForward = player->camera->forward;
+        pendingInput.lookRight = player->camera->right;
+    }
+
+    InputState takeInput()
+    {
+        std::lock_guard<std::mutex> lock(inputMutex);
+
+        InputState input = pendingInput;
+        pendingInput.leftClick = false;
+        pendingInput.rightClick = false;
+        return input;
+    }
+
+    // Simulation thread: one fixed-length step of input, physics, block edits and chunk generation
+    void tick(float dt)
+    {
+        PROFILE_SCOPE("tick");
+
+        tickBudget.begin(1000.0f / tickRate * tickBudgetShare);
+
+        InputState input = takeInput();
+
+        // Hold the player still until the chunk they are in has been generated
+        if (player->gamemode == SPECTATOR || world->isChunkReady(player->coord))
+        {
+            player->processInput(input, dt);
+            player->updatePhysics(dt);
+            player->updateCoord();
+        }
+        else
+            player->previousPosition = player->position;
+
+        entities->step(*world, dt);
+
+        if (player->gamemode != SPECTATOR)
+            player->updateTarget();
+
+        if (player->gamemode == CREATIVE || player->gamemode == SURVIVAL)
+            player->checkBlock();
+
+        if ((!(player->lastCoord == player->coord) && useRD) || player->checkRD())
+        {
+            world->refocus(player->coord, player->lookForward);
+            world->updateRenderDistance(player->coord);
+        }
+        else if (world->chunksToGenerate.isFocusStale(player->lookForward))
+            world->refocus(player->coord, player->lookForward);
+
+        world->prefetch(player->coord, player->position, player->velocity, player->lookForward);
+        world->unloadDistantChunks(player->coord);
+
+        player->lastCoord = player->coord;
+
+        // Enough work to keep every worker busy until the next tick
+        world->submitQueuedChunks(1000.0f / tickRate);
+        tickBudget.count(WORK_MESH, world->chunksMeshed.exchange(0));
+
+        // Block edits made this tick are only marked dirty; remesh them once here
+        world->flushDirtySections(player->coord, tickBudget);
+
+        world->freezeColdChunks(player->coord, glfwGetTime(), tickBudget);
+    }
+
     void cleanUp()
     {
         ImGui_ImplOpenGL3_Shutdown();
         ImGui_ImplGlfw_Shutdown();
         ImGui::DestroyContext();
 
+        world->stopGeneration();
+        world->saveAll();
+
         delete shader;
+        delete horizon;
+        delete chunkRenderer;
+        delete entities;
         delete player;
+        delete world;
         glDeleteBuffers(1, &outlineVBO);
         glDeleteVertexArrays(1, &outlineVAO);
         glfwTerminate();
@@ -242,22 +584,30 @@ private:
     {
         ImGui::Begin("Debug Info (F3)");
 
-        ImGui::SliderInt("Render Distance: ", &renderDistance, 1, 20);
+        if (ImGui::SliderInt("Render Distance: ", &renderDistanceSetting, 1, 20))
+        {
+            int rd = renderDistanceSetting;
+            postToSimulation([rd]()
+                             { renderDistance = rd; });
+        }
+        ImGui::Checkbox("Horizon", &useHorizon);
+        ImGui::SliderInt("Horizon Scale: ", &horizonScale, 2, 8);
 
         ImGui::Text("FPS: %.0f", 1.0f / dt);
         ImGui::Text("Delta Time: %.4f ms", dt * 1000.0f);
+        ImGui::Text("Tick Rate: %.0f Hz (%d last update, %.2f ms)", tickRate, frame.ticks, frame.tickMs);
 
         ImGui::Separator();
 
         glm::vec3 pos = player->camera->pos;
         ImGui::Text("Position: X:%.2f Y:%.2f Z:%.2f", pos.x, pos.y, pos.z);
 
-        ImGui::Text("Chunk Coords: X:%d Z:%d", player->coord.x, player->coord.z);
+        ImGui::Text("Chunk Coords: X:%d Z:%d", frame.playerCoord.x, frame.playerCoord.z);
 
         ImGui::Separator();
 
         const char *gamemode_str;
-        switch (player->gamemode)
+        switch (frame.gamemode)
         {
         case SPECTATOR:
             gamemode_str = "SPECTATOR";
@@ -273,8 +623,48 @@ private:
         }
         ImGui::Text("Gamemode: %s", gamemode_str);
 
-        ImGui::Text("Chunks Loaded: %zu", world->chunks.size());
-        ImGui::Text("Chunks Queued: %zu", world->chunksToGenerate.size());
+        ImGui::Text("Chunks Loaded: %zu", frame.chunksLoaded);
+        ImGui::Text("Chunks Queued: %zu", frame.chunksQueued);
+        ImGui::Text("Jobs Pending: %d (%d workers, %.2f ms/job)", frame.jobsPending, world->jobs.workerCount(), frame.jobMs);
+        ImGui::Text("Chunks Meshed: %d/s", frame.tickBudget.work[WORK_MESH].perSecond);
+
+        // Hits: chunks already meshed when they came into render distance
+        const PrefetchStats &prefetch = frame.prefetch;
+        ImGui::Text("Ready On Entry: %d/%d (%.0f%%)", prefetch.ready, prefetch.entered, prefetch.entered > 0 ? 100.0f * prefetch.ready / prefetch.entered : 0.0f);
+        ImGui::Text("Prefetched: %d/%d ready, %zu queued", prefetch.prefetchedReady, prefetch.prefetched, frame.chunksPrefetchQueued);
+        ImGui::Text("Horizon Tiles: %zu (%zu queued)", horizon->tiles.size(), horizon->tilesToBuild.size());
+        ImGui::Text("Chunk Voxels: %d hot, %d cold (%.1f MB saved)", frame.cold.hot, frame.cold.cold, frame.cold.bytesSaved / (1024.0f * 1024.0f));
+        ImGui::Text("Region Files: %d loaded, %d written (%.1f KB), %d queued", frame.regionLoads, frame.regionWrites, frame.regionBytes / 1024.0f, frame.regionPending);
+
+        ImGui::Separator();
+
+        drawMemory();
+
+        ImGui::Separator();
+
+        ImGui::SliderInt("Target FPS", &targetFPS, 30, 240);
+        ImGui::SliderFloat("Streaming Share", &frameBudgetShare, 0.05f, 0.9f);
+        ImGui::Text("Frame Budget: %.2f ms (%.2f ms spent)", frameBudget.budgetMs, frameBudget.spentMs);
+        drawWorkStats("Uploads", frameBudget.work[WORK_UPLOAD]);
+        drawWorkStats("Horizon", frameBudget.work[WORK_HORIZON]);
+        ImGui::Text("Tick Budget: %.2f ms (%.2f ms spent)", frame.tickBudget.budgetMs, frame.tickBudget.spentMs);
+        drawWorkStats("Remesh", frame.tickBudget.work[WORK_REMESH]);
+        drawWorkStats("Freeze", frame.tickBudget.work[WORK_FREEZE]);
+
+        ImGui::Separator();
+
+        ImGui::Text("Entities: %zu", frame.entityPositions.size());
+        if (ImGui::Button("Spawn 100 Mobs"))
+            postToSimulation([this]()
+                             { spawnEntities(ENTITY_MOB, 100); });
+        ImGui::SameLine();
+        if (ImGui::Button("Spawn 100 Items"))
+            postToSimulation([this]()
+                             { spawnEntities(ENTITY_ITEM, 100); });
+        ImGui::SameLine();
+        if (ImGui::Button("Clear"))
+            postToSimulation([this]()
+                             { entities->clear(); });
 
         ImGui::End();
 
@@ -282,7 +672,7 @@ private:
 
         for (int i = 0; i < lodeCount; i++)
         {
-            Lode &lode = lodes[i];
+            Lode &lode = lodeSettings[i];
 
             if (ImGui::CollapsingHeader(lode.name.c_str()))
             {
@@ -306,12 +696,257 @@ private:
                     lode.scale = sc;
                     lode.threshold = thresh;
 
-                    world->updateRenderDistance(player->coord, true);
+                    // Lodes belong to the simulation thread, so the edit is applied there
+                    postToSimulation([this, i, lode]()
+                                     { world->setLode(i, lode); });
                 }
             }
         }
 
         ImGui::End();
+
+        drawProfiler();
+    }
+
+    // Render thread scopes stacked per frame, the slowest recent frames, then every scope on every thread
+    void drawProfiler()
+    {
+        ImGui::Begin("Profiler");
+
+        bool enabled = profiler.enabled;
+        if (ImGui::Checkbox("Enabled", &enabled))
+            profiler.enabled = enabled;
+
+        ImGui::SliderInt("Trace Seconds", &traceSeconds, 1, 30);
+        if (profiler.capturing())
+            ImGui::Text("Recording trace: %.1f s left", profiler.captureSecondsLeft());
+        else if (ImGui::Button("Record Trace"))
+        {
+            profiler.enabled = true;
+            profiler.startCapture((float)traceSeconds, timestampedPath("trace", ".json"));
+        }
+        if (!profiler.lastCapture.empty())
+            ImGui::Text("Last trace: %s", profiler.lastCapture.c_str());
+
+        ImGui::Checkbox("Hitch Capture", &hitchCapture);
+        ImGui::SliderFloat("Hitch Factor", &hitchDetector.factor, 1.5f, 10.0f);
+        ImGui::Text("Median Frame: %.2f ms, %d hitches", hitchDetector.medianMs(), hitchDetector.hitches);
+        if (!lastHitchPath.empty())
+            ImGui::Text("Last hitch: %.1f ms (median %.1f ms), %s", hitchDetector.lastHitchMs, hitchDetector.lastMedianMs, lastHitchPath.c_str());
+
+        std::vector<const ProfileFrame *> history = profiler.frameHistory();
+
+        // One column per frame, with the time spent outside any top-level scope in grey on top. The line
+        // is the frame budget; the full height is twice that.
+        const float barWidth = 2.0f;
+        const float height = 120.0f;
+        float budgetMs = 1000.0f / targetFPS;
+        float scale = height / (2.0f * budgetMs);
+
+        ImVec2 origin = ImGui::GetCursorScreenPos();
+        ImVec2 size(Profiler::frameCapacity * barWidth, height);
+        float bottom = origin.y + height;
+        ImDrawList *draw = ImGui::GetWindowDrawList();
+        draw->AddRectFilled(origin, ImVec2(origin.x + size.x, bottom), IM_COL32(20, 20, 20, 200));
+
+        for (size_t i = 0; i < history.size(); i++)
+        {
+            const ProfileFrame &frame = *history[i];
+            float x = origin.x + i * barWidth;
+            float y = bottom;
+
+            for (const auto &stage : frame.stages)
+            {
+                float top = std::max(y - stage.second * scale, origin.y);
+                draw->AddRectFilled(ImVec2(x, top), ImVec2(x + barWidth, y), scopeColour(stage.first));
+                y = top;
+            }
+
+            float top = std::max(bottom - frame.ms() * scale, origin.y);
+            if (top < y)
+                draw->AddRectFilled(ImVec2(x, top), ImVec2(x + barWidth, y), IM_COL32(110, 110, 110, 255));
+        }
+
+        float budgetY = bottom - budgetMs * scale;
+        draw->AddLine(ImVec2(origin.x, budgetY), ImVec2(origin.x + size.x, budgetY), IM_COL32(255, 255, 255, 90));
+
+        ImGui::Dummy(size);
+        if (ImGui::IsItemHovered())
+        {
+            int i = (int)((ImGui::GetIO().MousePos.x - origin.x) / barWidth);
+            if (i >= 0 && i < (int)history.size())
+                ImGui::SetTooltip("%s", describeFrame(*history[i]).c_str());
+        }
+
+        if (ImGui::CollapsingHeader("Worst Frames"))
+        {
+            std::vector<const ProfileFrame *> worst = history;
+            std::sort(worst.begin(), worst.end(), [](const ProfileFrame *a, const ProfileFrame *b)
+                      { return a->ms() > b->ms(); });
+
+            for (int i = 0; i < std::min((int)worst.size(), 5); i++)
+                ImGui::Text("%s", describeFrame(*worst[i]).c_str());
+        }
+
+        if (ImGui::Button("Reset Worst"))
+            profiler.resetWorst();
+
+        if (ImGui::BeginTable("Scopes", 5))
+        {
+            ImGui::TableSetupColumn("Scope");
+            ImGui::TableSetupColumn("Calls");
+            ImGui::TableSetupColumn("ms/frame");
+            ImGui::TableSetupColumn("ms/call");
+            ImGui::TableSetupColumn("Worst ms");
+            ImGui::TableHeadersRow();
+
+            for (const ScopeStats &stats : profiler.scopeStats())
+            {
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();
+                ImGui::TextColored(ImGui::ColorConvertU32ToFloat4(scopeColour(stats.name)), "%s", stats.name);
+                ImGui::TableNextColumn();
+                ImGui::Text("%d", stats.calls);
+                ImGui::TableNextColumn();
+                ImGui::Text("%.3f", stats.frameMs);
+                ImGui::TableNextColumn();
+                ImGui::Text("%.3f", stats.callMs);
+                ImGui::TableNextColumn();
+                ImGui::Text("%.3f", stats.worstMs);
+            }
+            ImGui::EndTable();
+        }
+
+        ImGui::End();
+    }
+
+    // Writes the last hitchSeconds of profiler events as a trace, with where the player was and what the
+    // chunk queues held in the snapshot the hitch frame drew
+    void captureHitch(const ProfileFrame &hitch)
+    {
+        int64_t since = hitch.end - (int64_t)(hitchSeconds * 1e9);
+        std::vector<TraceEvent> events;
+        profiler.recentEvents(since, events);
+
+        int uploadsWaiting = 0;
+        for (Chunk *chunk : frame.visibleChunks)
+            uploadsWaiting += chunk->meshReady ? 1 : 0;
+
+        char metadata[1024];
+        snprintf(metadata, sizeof(metadata),
+                 "{\"frame_ms\": %.3f, \"median_ms\": %.3f, \"position\": [%.2f, %.2f, %.2f], \"chunk\": [%d, %d], "
+                 "\"render_distance\": %d, \"chunks_loaded\": %zu, \"chunks_queued\": %zu, \"prefetch_queued\": %zu, "
+                 "\"jobs_pending\": %d, \"chunks_uploading\": %d, \"horizon_tiles_queued\": %zu, \"region_writes_queued\": %d}",
+                 hitch.ms(), hitchDetector.lastMedianMs, frame.position.x, frame.position.y, frame.position.z,
+                 frame.playerCoord.x, frame.playerCoord.z, frame.renderDistance, frame.chunksLoaded, frame.chunksQueued,
+                 frame.chunksPrefetchQueued, frame.jobsPending, uploadsWaiting, horizon->tilesToBuild.size(), frame.regionPending);
+
+        lastHitchPath = timestampedPath(("hitch" + std::to_string(hitchDetector.hitches)).c_str(), ".json");
+        profiler.writeTraceLater(lastHitchPath, std::move(events), since, metadata);
+    }
+
+    // prefix_YYYYMMDD_HHMMSS followed by extension, in the working directory
+    static std::string timestampedPath(const char *prefix, const char *extension)
+    {
+        std::time_t now = std::time(nullptr);
+        char stamp[32];
+        std::strftime(stamp, sizeof(stamp), "%Y%m%d_%H%M%S", std::localtime(&now));
+        return std::string(prefix) + "_" + stamp + extension;
+    }
+
+    static std::string describeFrame(const ProfileFrame &frame)
+    {
+        char line[128];
+        snprintf(line, sizeof(line), "%.2f ms", frame.ms());
+
+        std::string text = line;
+        for (const auto &stage : frame.stages)
+        {
+            snprintf(line, sizeof(line), "\n  %s: %.2f ms", stage.first, stage.second);
+            text += line;
+        }
+        return text;
+    }
+
+    // Same colour for a scope name everywhere in the panel
+    static ImU32 scopeColour(const char *name)
+    {
+        static const ImU32 palette[] = {
+            IM_COL32(230, 120, 80, 255), IM_COL32(90, 170, 230, 255), IM_COL32(120, 200, 100, 255), IM_COL32(220, 190, 70, 255),
+            IM_COL32(180, 110, 220, 255), IM_COL32(80, 200, 190, 255), IM_COL32(230, 110, 160, 255), IM_COL32(160, 160, 230, 255)};
+
+        return palette[std::hash<std::string>()(name) % (sizeof(palette) / sizeof(palette[0]))];
+    }
+
+    static float megabytes(size_t bytes)
+    {
+        return bytes / (1024.0f * 1024.0f);
+    }
+
+    void drawMemory()
+    {
+        MemoryStats &memory = frame.memory;
+        memory.horizon = horizon->cpuBytes();
+        memory.gpuChunks = chunkRenderer->gpuBytes();
+        memory.gpuHorizon = horizon->gpuBytes();
+
+        const ChunkMemory &chunks = memory.chunkTotal;
+        float perChunk = memory.chunks > 0 ? 1.0f / (1024.0f * memory.chunks) : 0.0f;
+
+        ImGui::Text("Memory: %.1f MB CPU, %.1f MB GPU", megabytes(memory.cpuBytes()), megabytes(memory.gpuBytes()));
+        ImGui::Text("Voxels: %.1f MB (%.1f KB/chunk)", megabytes(chunks.voxels), chunks.voxels * perChunk);
+        ImGui::Text("Vertices: %.1f MB (%.1f KB/chunk)", megabytes(chunks.vertices), chunks.vertices * perChunk);
+        ImGui::Text("Edits: %.2f MB, Chunk Objects: %.2f MB", megabytes(chunks.edits), megabytes(chunks.object));
+        ImGui::Text("Largest Chunk: %.1f KB (%.1f KB voxels, %.1f KB vertices)", memory.largestChunk.total() / 1024.0f,
+                    memory.largestChunk.voxels / 1024.0f, memory.largestChunk.vertices / 1024.0f);
+        ImGui::Text("Chunk Map: %.2f MB, Queues: %.2f MB", megabytes(memory.chunkMap), megabytes(memory.queues));
+        ImGui::Text("Region Saves: %.2f MB queued, %.1f MB mapped", megabytes(memory.regionPending), megabytes(memory.regionMapped));
+        ImGui::Text("Profiler: %.1f MB, Horizon: %.1f MB", megabytes(memory.profiler), megabytes(memory.horizon));
+        ImGui::Text("GPU: %.1f MB chunks, %.1f MB horizon", megabytes(memory.gpuChunks), megabytes(memory.gpuHorizon));
+    }
+
+    void drawWorkStats(const char *label, const WorkStats &stats)
+    {
+        ImGui::Text("%s: %d this frame, %d/s, %.3f ms each", label, stats.doneThisFrame, stats.perSecond, stats.averageMs);
+    }
+
+    void spawnEntities(EntityType type, int amount)
+    {
+        for (int i = 0; i < amount; i++)
+        {
+            glm::vec3 offset((rand() % 200 - 100) / 10.0f, 2.0f + (rand() % 50) / 10.0f, (rand() % 200 - 100) / 10.0f);
+            glm::vec3 velocity((rand() % 100 - 50) / 10.0f, (rand() % 50) / 10.0f, (rand() % 100 - 50) / 10.0f);
+            entities->spawn(type, player->position + offset, velocity);
+        }
+    }
+
+    void renderEntities(const glm::mat4 &view, const glm::mat4 &projection, float tickAlpha)
+    {
+        outlineShader->use();
+        outlineShader->setMat4("view", view);
+        outlineShader->setMat4("projection", projection);
+        outlineShader->setFloat("lineWidth", 2.0f);
+
+        glBindVertexArray(outlineVAO);
+        glCullFace(GL_FRONT);
+
+        for (size_t i = 0; i < frame.entityPositions.size(); i++)
+        {
+            float width = frame.entitySizes[i].x;
+            float height = frame.entitySizes[i].y;
+
+            glm::vec3 pos = glm::mix(frame.entityPrevious[i], frame.entityPositions[i], tickAlpha);
+
+            glm::mat4 model = glm::mat4(1.0f);
+            model = glm::translate(model, pos + glm::vec3(0.0f, height * 0.5f, 0.0f));
+            model = glm::scale(model, glm::vec3(width, height, width));
+
+            outlineShader->setMat4("model", model);
+            glDrawArrays(GL_LINES, 0, 24);
+        }
+
+        glCullFace(GL_BACK);
+        glBindVertexArray(0);
     }
 
     void drawCrosshair()
@@ -405,7 +1040,10 @@ private:
         if (glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS)
         {
             if (!pauseClicked)
+            {
                 paused = !paused;
+                simPaused = paused;
+            }
             pauseClicked = true;
         }
         else
@@ -0,0 +1,281 @@
+#include "profiler.h"
+
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+#include <fstream>
+
+Profiler profiler;
+
+namespace
+{
+    thread_local ProfileThread *current = nullptr;
+
+    void writeJsonString(std::ostream &out, const std::string &text)
+    {
+        out << '"';
+        for (char c : text)
+        {
+            if (c == '"' || c == '\\')
+                out << '\\' << c;
+            else if ((unsigned char)c >= 0x20)
+                out << c;
+        }
+        out << '"';
+    }
+}
+
+Profiler::~Profiler()
+{
+    if (traceWriter.joinable())
+        traceWriter.join();
+}
+
+int64_t Profiler::now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Profiler::setThreadName(const std::string &name)
+{
+    ProfileThread &buffer = thread();
+    std::lock_guard<std::mutex> lock(buffer.mutex);
+    buffer.name = name;
+}
+
+ProfileThread &Profiler::thread()
+{
+    if (current != nullptr)
+        return *current;
+
+    std::lock_guard<std::mutex> lock(threadsMutex);
+    threads.push_back(std::make_unique<ProfileThread>());
+
+    ProfileThread &buffer = *threads.back();
+    buffer.id = (int)threads.size();
+    buffer.name = "thread " + std::to_string(buffer.id);
+    buffer.events.resize(eventCapacity);
+
+    current = &buffer;
+    return buffer;
+}
+
+void Profiler::record(ProfileThread &thread, const ProfileEvent &event)
+{
+    std::lock_guard<std::mutex> lock(thread.mutex);
+    thread.events[thread.written % eventCapacity] = event;
+    thread.written++;
+}
+
+const ProfileFrame &Profiler::markFrame()
+{
+    int64_t end = now();
+    ProfileThread *renderThread = &thread();
+
+    if (frames.empty())
+        frames.resize(frameCapacity);
+
+    ProfileFrame &frame = frames[framesDone % frameCapacity];
+    frame.start = frameStart != 0 ? frameStart : end;
+    frame.end = end;
+    frame.stages.clear();
+
+    for (ScopeStats &stats : scopes)
+    {
+        stats.calls = 0;
+        stats.lastMs = 0.0f;
+    }
+
+    std::vector<ProfileThread *> buffers;
+    {
+        std::lock_guard<std::mutex> lock(threadsMutex);
+        for (auto &buffer : threads)
+            buffers.push_back(buffer.get());
+    }
+
+    for (ProfileThread *buffer : buffers)
+    {
+        std::lock_guard<std::mutex> lock(buffer->mutex);
+
+        // Anything the writer has already lapped is lost
+        if (buffer->written - buffer->read > (uint64_t)eventCapacity)
+            buffer->read = buffer->written - eventCapacity;
+
+        for (; buffer->read < buffer->written; buffer->read++)
+        {
+            const ProfileEvent &event = buffer->events[buffer->read % eventCapacity];
+            float ms = (event.end - event.start) / 1e6f;
+
+            ScopeStats &stats = scope(event.name);
+            stats.calls++;
+            stats.lastMs += ms;
+            stats.callMs = stats.callMs == 0.0f ? ms : stats.callMs + (ms - stats.callMs) * 0.05f;
+            stats.worstMs = std::max(stats.worstMs, ms);
+
+            if (buffer == renderThread && event.depth == 0)
+                frame.stages.emplace_back(event.name, ms);
+
+            if (capturing() && event.end >= captureStart)
+                captured.push_back({event, buffer->id});
+        }
+    }
+
+    if (capturing())
+    {
+        captured.push_back({{"frame", frame.start, frame.end, 0}, renderThread->id});
+        if (end >= captureEnd)
+            finishCapture();
+    }
+
+    for (ScopeStats &stats : scopes)
+        stats.frameMs += (stats.lastMs - stats.frameMs) * 0.05f;
+
+    framesDone++;
+    frameStart = end;
+    return frame;
+}
+
+std::vector<const ProfileFrame *> Profiler::frameHistory() const
+{
+    std::vector<const ProfileFrame *> history;
+
+    int count = std::min(framesDone, frameCapacity);
+    for (int i = framesDone - count; i < framesDone; i++)
+        history.push_back(&frames[i % frameCapacity]);
+
+    return history;
+}
+
+void Profiler::resetWorst()
+{
+    for (ScopeStats &stats : scopes)
+        stats.worstMs = 0.0f;
+}
+
+size_t Profiler::memoryBytes()
+{
+    std::lock_guard<std::mutex> lock(threadsMutex);
+    return threads.size() * (sizeof(ProfileThread) + eventCapacity * sizeof(ProfileEvent));
+}
+
+ScopeStats &Profiler::scope(const char *name)
+{
+    // Few distinct names, and the same literal is usually the same pointer
+    for (ScopeStats &stats : scopes)
+    {
+        if (stats.name == name || strcmp(stats.name, name) == 0)
+            return stats;
+    }
+
+    scopes.emplace_back();
+    scopes.back().name = name;
+    return scopes.back();
+}
+
+void Profiler::startCapture(float seconds, const std::string &path)
+{
+    captureStart = now();
+    captureEnd = captureStart + (int64_t)(seconds * 1e9);
+    capturePath = path;
+    captured.clear();
+}
+
+float Profiler::captureSecondsLeft() const
+{
+    return capturing() ? std::max(0.0f, (captureEnd - now()) / 1e9f) : 0.0f;
+}
+
+void Profiler::finishCapture()
+{
+    lastCapture = capturePath + " (" + std::to_string(captured.size()) + " events)";
+    writeTraceLater(capturePath, std::move(captured), captureStart);
+
+    captured.clear();
+    captureEnd = 0;
+}
+
+void Profiler::recentEvents(int64_t since, std::vector<TraceEvent> &out)
+{
+    ProfileThread *renderThread = &thread();
+
+    std::vector<ProfileThread *> buffers;
+    {
+        std::lock_guard<std::mutex> lock(threadsMutex);
+        for (auto &buffer : threads)
+            buffers.push_back(buffer.get());
+    }
+
+    for (ProfileThread *buffer : buffers)
+    {
+        std::lock_guard<std::mutex> lock(buffer->mutex);
+
+        uint64_t first = buffer->written > (uint64_t)eventCapacity ? buffer->written - eventCapacity : 0;
+        for (uint64_t i = first; i < buffer->written; i++)
+        {
+            const ProfileEvent &event = buffer->events[i % eventCapacity];
+            if (event.end >= since)
+                out.push_back({event, buffer->id});
+        }
+    }
+
+    for (const ProfileFrame *frame : frameHistory())
+    {
+        if (frame->end >= since)
+            out.push_back({{"frame", frame->start, frame->end, 0}, renderThread->id});
+    }
+}
+
+void Profiler::writeTraceLater(const std::string &path, std::vector<TraceEvent> events, int64_t origin, const std::string &metadata)
+{
+    // One trace written at a time
+    if (traceWriter.joinable())
+        traceWriter.join();
+
+    traceWriter = std::thread([this, path, events = std::move(events), origin, metadata]()
+                              { writeTrace(path, events, origin, metadata); });
+}
+
+void Profiler::writeTrace(const std::string &path, const std::vector<TraceEvent> &events, int64_t origin, const std::string &metadata)
+{
+    std::vector<std::pair<int, std::string>> names;
+    {
+        std::lock_guard<std::mutex> lock(threadsMutex);
+        for (auto &buffer : threads)
+        {
+            std::lock_guard<std::mutex> bufferLock(buffer->mutex);
+            names.emplace_back(buffer->id, buffer->name);
+        }
+    }
+
+    std::ofstream out(path);
+    if (!out)
+        return;
+
+    // Complete ("X") events in microseconds, one process, a track per thread
+    out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+    const char *separator = "\n";
+    for (auto &name : names)
+    {
+        out << separator << "{\"ph\": \"M\", \"name\": \"thread_name\", \"pid\": 1, \"tid\": " << name.first << ", \"args\": {\"name\": ";
+        writeJsonString(out, name.second);
+        out << "}}";
+        separator = ",\n";
+    }
+
+    out.precision(3);
+    out << std::fixed;
+    for (const TraceEvent &trace : events)
+    {
+        const ProfileEvent &event = trace.event;
+        out << separator << "{\"ph\": \"X\", \"name\": ";
+        writeJsonString(out, event.name);
+        out << ", \"pid\": 1, \"tid\": " << trace.thread << ", \"ts\": " << (event.start - origin) / 1e3
+            << ", \"dur\": " << (event.end - event.start) / 1e3 << "}";
+        separator = ",\n";
+    }
+    out << "\n]";
+
+    if (!metadata.empty())
+        out << ",\n\"metadata\": " << metadata;
+    out << "}\n";
+}
@@ -0,0 +1,351 @@
+#include "regionFile.h"
+
+#include <fstream>
+#include <iostream>
+#include <chrono>
+#include <filesystem>
+#include <cstring>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+namespace
+{
+    struct RegionHeader
+    {
+        char magic[4] = {'V', 'X', 'R', 'G'};
+        uint32_t version = 3; // 1 held whole chunks, 2 had payloads without a kind byte
+        uint32_t chunkWidth = 0; // Saves from a different chunk size are ignored
+        uint32_t chunkHeight = 0;
+    };
+
+    const int regionChunks = RegionStore::regionSize * RegionStore::regionSize;
+
+    // How long the writer waits before trying a failed write again
+    const std::chrono::seconds retryDelay(1);
+}
+
+RegionStore::RegionStore(const std::string &directory)
+{
+    this->directory = directory;
+    std::filesystem::create_directories(directory);
+
+    writer = std::thread(&RegionStore::writerLoop, this);
+}
+
+RegionStore::~RegionStore()
+{
+    {
+        std::lock_guard<std::mutex> lock(pendingMutex);
+        running = false;
+    }
+    pendingChanged.notify_all();
+    writer.join();
+
+    for (auto &pair : regions)
+        unmap(*pair.second);
+}
+
+bool RegionStore::load(ChunkCoord coord, std::vector<uint8_t> &payload)
+{
+    {
+        std::lock_guard<std::mutex> lock(pendingMutex);
+        auto it = pending.find(coord);
+        if (it != pending.end())
+        {
+            payload = *it->second;
+            chunksLoaded++;
+            return true;
+        }
+    }
+
+    Region &region = getRegion(regionOf(coord));
+    std::shared_lock<std::shared_mutex> lock(region.lock);
+
+    size_t tableEnd = sizeof(RegionHeader) + regionChunks * sizeof(Entry);
+    if (region.data == nullptr || region.size < tableEnd)
+        return false;
+
+    RegionHeader header;
+    memcpy(&header, region.data, sizeof(header));
+    if (memcmp(header.magic, "VXRG", 4) != 0 || header.version != RegionHeader().version || header.chunkWidth != (uint32_t)chunkWidth || header.chunkHeight != (uint32_t)chunkHeight)
+        return false;
+
+    Entry entry;
+    memcpy(&entry, region.data + sizeof(RegionHeader) + indexInRegion(coord) * sizeof(Entry), sizeof(entry));
+    if (entry.offset == 0 || (size_t)entry.offset + entry.size > region.size)
+        return false;
+
+    payload.assign(region.data + entry.offset, region.data + entry.offset + entry.size);
+    chunksLoaded++;
+    return true;
+}
+
+void RegionStore::save(ChunkCoord coord, std::vector<uint8_t> payload)
+{
+    {
+        std::lock_guard<std::mutex> lock(pendingMutex);
+        pending[coord] = std::make_shared<const std::vector<uint8_t>>(std::move(payload));
+    }
+    pendingChanged.notify_all();
+}
+
+void RegionStore::flush()
+{
+    std::unique_lock<std::mutex> lock(pendingMutex);
+    pendingChanged.wait(lock, [this]()
+                        { return (pending.empty() || failing) && !writing; });
+}
+
+int RegionStore::pendingWrites()
+{
+    std::lock_guard<std::mutex> lock(pendingMutex);
+    return (int)pending.size();
+}
+
+size_t RegionStore::pendingBytes()
+{
+    std::lock_guard<std::mutex> lock(pendingMutex);
+
+    size_t bytes = hashContainerBytes(pending, sizeof(std::pair<const ChunkCoord, Payload>));
+    for (auto &pair : pending)
+        bytes += pair.second->capacity();
+    return bytes;
+}
+
+size_t RegionStore::mappedBytes()
+{
+    std::vector<Region *> all;
+    {
+        std::lock_guard<std::mutex> lock(regionsMutex);
+        for (auto &pair : regions)
+            all.push_back(pair.second.get());
+    }
+
+    // A region being rewritten is unmapped at the time, and waiting for the writer would stall the caller
+    size_t bytes = 0;
+    for (Region *region : all)
+    {
+        std::shared_lock<std::shared_mutex> lock(region->lock, std::try_to_lock);
+        if (lock.owns_lock())
+            bytes += region->size;
+    }
+    return bytes;
+}
+
+RegionStore::Region &RegionStore::getRegion(ChunkCoord regionCoord)
+{
+    std::lock_guard<std::mutex> lock(regionsMutex);
+
+    std::unique_ptr<Region> &region = regions[regionCoord];
+    if (!region)
+    {
+        region = std::make_unique<Region>();
+        region->path = directory + "/r." + std::to_string(regionCoord.x) + "." + std::to_string(regionCoord.z) + ".region";
+        map(*region);
+    }
+
+    return *region;
+}
+
+// Caller holds region.lock exclusively, or is the only one who can see the region
+void RegionStore::map(Region &region)
+{
+#ifndef _WIN32
+    int fd = open(region.path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return;
+
+    struct stat info;
+    if (fstat(fd, &info) == 0 && info.st_size > 0)
+    {
+        void *data = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (data != MAP_FAILED)
+        {
+            region.data = (const uint8_t *)data;
+            region.size = (size_t)info.st_size;
+        }
+    }
+    close(fd);
+#else
+    std::ifstream file(region.path, std::ios::binary);
+    if (!file)
+        return;
+
+    region.copy.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    region.data = region.copy.data();
+    region.size = region.copy.size();
+#endif
+}
+
+void RegionStore::unmap(Region &region)
+{
+#ifndef _WIN32
+    if (region.data != nullptr)
+        munmap((void *)region.data, region.size);
+#else
+    region.copy.clear();
+    region.copy.shrink_to_fit();
+#endif
+    region.data = nullptr;
+    region.size = 0;
+}
+
+bool RegionStore::writeRegion(Region &region, std::vector<std::pair<ChunkCoord, Payload>> &chunks)
+{
+    std::unique_lock<std::shared_mutex> lock(region.lock);
+    unmap(region);
+
+    RegionHeader header;
+    header.chunkWidth = chunkWidth;
+    header.chunkHeight = chunkHeight;
+    std::vector<Entry> table(regionChunks);
+
+    std::fstream file(region.path, std::ios::in | std::ios::out | std::ios::binary);
+    RegionHeader existing;
+    bool valid = file && file.read((char *)&existing, sizeof(existing)) &&
+                 memcmp(existing.magic, "VXRG", 4) == 0 && existing.version == header.version && existing.chunkWidth == header.chunkWidth && existing.chunkHeight == header.chunkHeight &&
+                 file.read((char *)table.data(), table.size() * sizeof(Entry));
+
+    if (!valid)
+    {
+        // New file, or one from another version or chunk size: start over
+        table.assign(regionChunks, Entry());
+        file.close();
+        file.open(region.path, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+        file.write((const char *)&header, sizeof(header));
+        file.write((const char *)table.data(), table.size() * sizeof(Entry));
+    }
+
+    file.seekp(0, std::ios::end);
+    uint32_t end = (uint32_t)file.tellp();
+    if (!file)
+    {
+        map(region);
+        return false;
+    }
+
+    for (size_t i = 0; i < chunks.size(); i++)
+    {
+        const std::vector<uint8_t> &payload = *chunks[i].second;
+        Entry &entry = table[indexInRegion(chunks[i].first)];
+
+        if (entry.offset == 0 || payload.size() > entry.capacity)
+        {
+            entry.offset = end;
+            entry.capacity = (uint32_t)payload.size();
+            end += entry.capacity;
+        }
+        entry.size = (uint32_t)payload.size();
+
+        file.seekp(entry.offset);
+        file.write((const char *)payload.data(), payload.size());
+    }
+
+    // The table is only written once every payload it points at is
+    if (file)
+    {
+        file.seekp(sizeof(RegionHeader));
+        file.write((const char *)table.data(), table.size() * sizeof(Entry));
+    }
+    bool written = (bool)file;
+    file.close();
+    written = written && !file.fail();
+
+    map(region);
+
+    if (!written)
+        return false;
+
+    for (auto &pair : chunks)
+    {
+        chunksWritten++;
+        bytesWritten += (long long)pair.second->size();
+    }
+    return true;
+}
+
+void RegionStore::writerLoop()
+{
+    while (true)
+    {
+        std::unordered_map<ChunkCoord, Payload> batch;
+        {
+            std::unique_lock<std::mutex> lock(pendingMutex);
+            pendingChanged.wait(lock, [this]()
+                                { return !pending.empty() || !running; });
+
+            if (pending.empty())
+                return;
+
+            batch = pending; // Only the pointers; the payloads stay loadable until written
+            writing = true;
+        }
+
+        std::unordered_map<ChunkCoord, std::vector<std::pair<ChunkCoord, Payload>>> byRegion;
+        for (auto &pair : batch)
+            byRegion[regionOf(pair.first)].push_back(pair);
+
+        int failed = 0;
+        for (auto it = byRegion.begin(); it != byRegion.end();)
+        {
+            Region &region = getRegion(it->first);
+            if (writeRegion(region, it->second))
+            {
+                it++;
+                continue;
+            }
+
+            std::cout << "Failed to write " << it->second.size() << " chunks to " << region.path << ", will try again" << std::endl;
+            failed += (int)it->second.size();
+            it = byRegion.erase(it);
+        }
+
+        {
+            std::unique_lock<std::mutex> lock(pendingMutex);
+
+            // Only what reached the disk leaves the queue. Anything saved again while this batch was written,
+            // and anything that failed to write, stays queued.
+            for (auto &region : byRegion)
+            {
+                for (auto &pair : region.second)
+                {
+                    auto it = pending.find(pair.first);
+                    if (it != pending.end() && it->second == pair.second)
+                        pending.erase(it);
+                }
+            }
+            writing = false;
+            failing = failed > 0;
+            writeFailures += failed;
+            pendingChanged.notify_all();
+
+            if (failed > 0)
+            {
+                if (!running)
+                {
+                    std::cout << "Giving up on " << pending.size() << " unsaved chunks" << std::endl;
+                    return;
+                }
+
+                pendingChanged.wait_for(lock, retryDelay, [this]()
+                                        { return !running; });
+            }
+        }
+    }
+}
+
+ChunkCoord RegionStore::regionOf(ChunkCoord coord)
+{
+    // Chunk coordinates are never negative (the world starts at 0)
+    return ChunkCoord(coord.x / regionSize, coord.z / regionSize);
+}
+
+int RegionStore::indexInRegion(ChunkCoord coord)
+{
+    return (coord.x % regionSize) * regionSize + coord.z % regionSize;
+}
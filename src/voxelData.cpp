@@ -3,6 +3,7 @@
 int worldWidth = 100;
 int chunkWidth = 16;
 int chunkHeight = 128;
+int sectionHeight = 16; // Chunks are meshed in chunkHeight / sectionHeight slices
 
 float biomeScale = 0.007f;
 int terrainMinHeight = 50;
@@ -31,6 +32,18 @@ int treeMaxHeight = 7;
 
 bool useRD = false;
 int renderDistance = 5;
+int keepAliveDistance = 3; // Chunks further than renderDistance + this are saved and unloaded
+float coldChunkSeconds = 10.0f; // Chunks no voxel query has touched for this long are compressed
+
+const char *saveDirectory = "world"; // Region files, relative to the working directory
+
+bool useHorizon = true;
+int horizonScale = 4;      // Horizon radius as a multiple of renderDistance
+int horizonStep = 4;       // Blocks between heightfield samples
+int horizonTileChunks = 4; // Chunks per horizon tile side
+
+int targetFPS = 60;            // Frame rate the streaming budget is sized for
+float frameBudgetShare = 0.2f; // Share of each frame spent uploading meshes and building horizon tiles
 
 float cubeVertices[] = {
     // Position (3D)       | Normal (3D)         | TexCoords (2D)
@@ -95,13 +108,14 @@ int faceChecks[6][3] = {
 
 BlockType blockTypes[] =
 {
-    //         Textures           Solid  Name   Transp Air Liquid
-    BlockType({0, 0, 0, 0, 0, 0}, false, "Air", true, true),
-    BlockType({1, 1, 1, 1, 0, 2}, true, "Grass Block"),
-    BlockType({2, 2, 2, 2, 2, 2}, true, "Dirt Block"),
-    BlockType({3, 3, 3, 3, 3, 3}, true, "Stone Block"),
-    BlockType({4, 4, 4, 4, 5, 5}, true, "Oak Log"),
-    BlockType({6, 6, 6, 6, 6, 6}, true, "Oak Leaves", true),
-    BlockType({7, 7, 7, 7, 7, 7}, true, "Sand"),
-    BlockType({8, 8, 8, 8, 8, 8}, false, "Water", true, false, true),
+    //     ID Textures            Solid  Name   Transp Air Liquid
+    BlockType(0, {0, 0, 0, 0, 0, 0}, false, "Air", true, true),
+    BlockType(1, {1, 1, 1, 1, 0, 2}, true, "Grass Block"),
+    BlockType(2, {2, 2, 2, 2, 2, 2}, true, "Dirt Block"),
+    BlockType(3, {3, 3, 3, 3, 3, 3}, true, "Stone Block"),
+    BlockType(4, {4, 4, 4, 4, 5, 5}, true, "Oak Log"),
+    BlockType(5, {6, 6, 6, 6, 6, 6}, true, "Oak Leaves", true),
+    BlockType(6, {7, 7, 7, 7, 7, 7}, true, "Sand"),
+    BlockType(7, {8, 8, 8, 8, 8, 8}, false, "Water", true, false, true),
 };
+int blockTypeCount = sizeof(blockTypes) / sizeof(blockTypes[0]);
@@ -0,0 +1,231 @@
+// Checks of the bulk edit API (World::fillRegion and friends) on real generated chunks. Every box
+// crosses a chunk border, since that is where the per-chunk spans have to line up. Edits are also
+// saved to region files in the temp directory and loaded back, and a chunk unloaded from among
+// loaded neighbours has to come back voxel for voxel.
+//
+//   world_tests
+//
+// Prints each failed check and exits non-zero if there were any.
+
+#include <iostream>
+#include <string>
+#include <memory>
+#include <filesystem>
+#include <vector>
+#include <unordered_map>
+
+#include "voxelData.h"
+#include "world.h"
+
+namespace
+{
+    int failures = 0;
+
+    void check(bool ok, const std::string &what)
+    {
+        if (!ok)
+        {
+            std::cout << "FAILED: " << what << std::endl;
+            failures++;
+        }
+    }
+
+    // Runs the pipeline until every chunk in [lo, hi] is ready
+    void loadChunks(World &world, ChunkCoord lo, ChunkCoord hi)
+    {
+        for (int x = lo.x; x <= hi.x; x++)
+            for (int z = lo.z; z <= hi.z; z++)
+                world.requestMesh(ChunkCoord(x, z));
+        world.jobs.waitIdle();
+    }
+
+    void deleteChunks(World &world)
+    {
+        world.stopGeneration();
+        for (auto &pair : world.chunks)
+            delete pair.second;
+        world.chunks.clear();
+        for (Chunk *chunk : world.retiredChunks)
+            delete chunk;
+        world.retiredChunks.clear();
+    }
+
+    // Whether every voxel in the inclusive box is `block`
+    bool boxIs(World &world, glm::ivec3 lo, glm::ivec3 hi, int block)
+    {
+        for (int x = lo.x; x <= hi.x; x++)
+            for (int y = lo.y; y <= hi.y; y++)
+                for (int z = lo.z; z <= hi.z; z++)
+                    if (world.getVoxel(x, y, z).id != block)
+                        return false;
+        return true;
+    }
+
+    // Fill, replace, copy and paste over the border between chunks x 50 and 51, above the terrain
+    void testBulkEdits()
+    {
+        World world(2);
+        loadChunks(world, ChunkCoord(50, 49), ChunkCoord(51, 50));
+
+        int border = 51 * chunkWidth;
+        glm::ivec3 lo(border - 2, 115, 50 * chunkWidth + 1);
+        glm::ivec3 hi(border + 1, 117, 50 * chunkWidth + 3);
+
+        check(world.fillRegion(lo, hi, 6) == 4 * 3 * 3, "fillRegion count");
+        check(boxIs(world, lo, hi, 6), "fillRegion writes both sides of the border");
+        check(world.getVoxel(lo.x - 1, lo.y, lo.z).id == 0 && world.getVoxel(hi.x + 1, lo.y, lo.z).id == 0, "fillRegion stays inside the box");
+        check(world.dirtySections.count(ChunkCoord(50, 50)) && world.dirtySections.count(ChunkCoord(51, 50)), "fillRegion marks both chunks dirty");
+
+        // A wider box, so only the sand is replaced and the air around it is left alone
+        check(world.replaceRegion(lo - glm::ivec3(1), hi + glm::ivec3(1), 6, 3) == 4 * 3 * 3, "replaceRegion count");
+        check(boxIs(world, lo, hi, 3), "replaceRegion writes both sides of the border");
+        check(world.getVoxel(lo.x - 1, lo.y, lo.z).id == 0, "replaceRegion leaves other blocks");
+
+        // Pasted three blocks lower in z, so it also crosses the z border
+        RegionBuffer buffer = world.copyRegion(lo, hi);
+        check(buffer.size == hi - lo + glm::ivec3(1), "copyRegion size");
+
+        glm::ivec3 offset(0, 0, -3);
+        check(world.pasteRegion(buffer, lo + offset) == 4 * 3 * 3, "pasteRegion count");
+        check(boxIs(world, lo + offset, hi + offset, 3), "pasteRegion writes across both borders");
+
+        deleteChunks(world);
+    }
+
+    // Bulk edits are saved as edits when their chunks unload, and come back over regenerated terrain
+    void testBulkEditsSurviveReload()
+    {
+        std::string directory = (std::filesystem::temp_directory_path() / "world_tests_regions").string();
+        std::filesystem::remove_all(directory);
+
+        int border = 51 * chunkWidth;
+        glm::ivec3 lo(border - 2, 60, 50 * chunkWidth + 1);
+        glm::ivec3 hi(border + 1, 62, 50 * chunkWidth + 3);
+        glm::ivec3 centre(border, 40, 50 * chunkWidth + 8);
+
+        {
+            World world(2);
+            world.regions = std::make_unique<RegionStore>(directory);
+            loadChunks(world, ChunkCoord(50, 50), ChunkCoord(51, 50));
+
+            world.fillRegion(lo, hi, 6);
+            world.fillSphere(centre, 2.0f, 0);
+            world.setVoxel(border - 4, 60, 50 * chunkWidth + 1, 4);
+
+            // Far from every chunk, so they are all saved and unloaded
+            world.unloadDistantChunks(ChunkCoord(0, 0));
+            check(world.chunks.empty(), "unloadDistantChunks unloads the area");
+            world.regions->flush();
+            deleteChunks(world);
+        }
+
+        World world(2);
+        world.regions = std::make_unique<RegionStore>(directory);
+        loadChunks(world, ChunkCoord(50, 50), ChunkCoord(51, 50));
+
+        check(boxIs(world, lo, hi, 6), "fillRegion survives a reload");
+        check(boxIs(world, centre - glm::ivec3(1), centre + glm::ivec3(1), 0), "fillSphere survives a reload");
+        check(world.getVoxel(border - 4, 60, 50 * chunkWidth + 1).id == 4, "setVoxel survives a reload");
+
+        deleteChunks(world);
+        world.regions.reset();
+        std::filesystem::remove_all(directory);
+    }
+
+    // A chunk unloaded while its neighbours stay loaded is generated again with all of its neighbours'
+    // trees that reach into it, and the neighbours are left as they were
+    void testRegeneratedChunkMatches()
+    {
+        World world(2);
+        ChunkCoord lo(20, 49), hi(30, 51);
+        loadChunks(world, lo, hi);
+
+        std::unordered_map<ChunkCoord, std::vector<uint8_t>> before;
+        for (auto &pair : world.chunks)
+            pair.second->getBlocks(before[pair.first]);
+
+        for (int x = lo.x + 1; x < hi.x; x++)
+        {
+            ChunkCoord coord(x, 50);
+            Chunk *chunk = world.chunks[coord];
+            world.chunks.erase(coord);
+            world.dirtySections.erase(coord);
+            world.retireChunk(chunk);
+            loadChunks(world, coord, coord);
+        }
+
+        int differ = 0;
+        std::vector<uint8_t> after;
+        for (auto &pair : world.chunks)
+        {
+            pair.second->getBlocks(after);
+            if (after != before[pair.first])
+                differ++;
+        }
+        check(world.chunks.size() == before.size(), "regenerated chunks are loaded again");
+        check(differ == 0, "regenerated chunks match, " + std::to_string(differ) + " differ");
+
+        deleteChunks(world);
+    }
+
+    // Chunks saved and unloaded by unloadDistantChunks, next to chunks it keeps, load back as they were,
+    // edits included
+    void testUnloadRoundTrip()
+    {
+        std::string directory = (std::filesystem::temp_directory_path() / "world_tests_unload").string();
+        std::filesystem::remove_all(directory);
+
+        World world(2);
+        world.regions = std::make_unique<RegionStore>(directory);
+        ChunkCoord lo(20, 49), hi(30, 51);
+        loadChunks(world, lo, hi);
+        world.fillRegion(glm::ivec3(29 * chunkWidth - 2, 70, 50 * chunkWidth), glm::ivec3(29 * chunkWidth + 1, 72, 50 * chunkWidth + 2), 6);
+
+        std::unordered_map<ChunkCoord, std::vector<uint8_t>> before;
+        for (auto &pair : world.chunks)
+            pair.second->getBlocks(before[pair.first]);
+
+        // Keeps x 28 and below, and unloads the rest. The pipeline also loaded the chunks around the strip.
+        size_t kept = 0;
+        for (auto &pair : before)
+            kept += pair.first.x <= 28;
+
+        ChunkCoord centre(28 - renderDistance - keepAliveDistance, 50);
+        world.unloadDistantChunks(centre);
+        check(world.chunks.size() == kept, "unloadDistantChunks unloads the far side of the strip");
+
+        loadChunks(world, ChunkCoord(29, lo.z), hi);
+
+        int differ = 0;
+        std::vector<uint8_t> after;
+        for (auto &pair : world.chunks)
+        {
+            pair.second->getBlocks(after);
+            if (after != before[pair.first])
+                differ++;
+        }
+        check(world.chunks.size() == before.size(), "unloaded chunks are loaded again");
+        check(differ == 0, "reloaded chunks match, " + std::to_string(differ) + " differ");
+
+        deleteChunks(world);
+        world.regions.reset();
+        std::filesystem::remove_all(directory);
+    }
+}
+
+int main()
+{
+    testBulkEdits();
+    testBulkEditsSurviveReload();
+    testRegeneratedChunkMatches();
+    testUnloadRoundTrip();
+
+    if (failures > 0)
+    {
+        std::cout << failures << " checks failed" << std::endl;
+        return 1;
+    }
+
+    std::cout << "all checks passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,272 @@
+// Headless benchmark of world generation, meshing and voxel queries over a fixed area. Worldgen noise
+// is seeded in code, so the same area gives the same work on every run. Prints one JSON object, so
+// results can be kept and compared between builds.
+//
+//   voxel_bench [--size N] [--centre X Z] [--queries Q] [--threads T]
+//
+// Each stage is timed one chunk at a time on this thread, for per-chunk latency percentiles. The job
+// pipeline is then run over the same area on T workers for end-to-end throughput.
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <random>
+#include <cstdlib>
+#include <chrono>
+
+#include "voxelData.h"
+#include "world.h"
+#include "collision.h"
+
+namespace
+{
+    typedef std::chrono::steady_clock Clock;
+
+    struct Options
+    {
+        int size = 8;
+        ChunkCoord centre = ChunkCoord(worldWidth / 2, worldWidth / 2);
+        int queries = 10000;
+        int threads = 0;
+    };
+
+    // Latencies of one stage, in milliseconds
+    struct Samples
+    {
+        std::string name;
+        std::vector<double> ms;
+
+        Samples(const std::string &name) : name(name) {}
+
+        template <typename Fn>
+        void time(Fn fn)
+        {
+            Clock::time_point start = Clock::now();
+            fn();
+            ms.push_back(std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+        }
+
+        double total() const
+        {
+            double sum = 0.0;
+            for (double m : ms)
+                sum += m;
+            return sum;
+        }
+
+        static double percentile(const std::vector<double> &sorted, double p)
+        {
+            size_t i = (size_t)(p * (sorted.size() - 1) + 0.5);
+            return sorted[std::min(i, sorted.size() - 1)];
+        }
+
+        void write(std::ostream &out) const
+        {
+            std::vector<double> sorted = ms;
+            std::sort(sorted.begin(), sorted.end());
+            if (sorted.empty())
+                sorted.push_back(0.0);
+
+            out << "\"" << name << "\": {\"count\": " << ms.size() << ", \"total_ms\": " << total()
+                << ", \"mean_ms\": " << total() / std::max<size_t>(ms.size(), 1)
+                << ", \"p50_ms\": " << percentile(sorted, 0.5) << ", \"p90_ms\": " << percentile(sorted, 0.9)
+                << ", \"p99_ms\": " << percentile(sorted, 0.99) << ", \"max_ms\": " << sorted.back() << "}";
+        }
+    };
+
+    void usage()
+    {
+        std::cout << "usage: voxel_bench [--size N] [--centre X Z] [--queries Q] [--threads T]" << std::endl;
+        std::cout << "  --size N      side of the square of chunks to build (default 8)" << std::endl;
+        std::cout << "  --centre X Z  chunk the square is centred on (default the middle of the world)" << std::endl;
+        std::cout << "  --queries Q   raycasts, and collision sweeps, to time (default 10000)" << std::endl;
+        std::cout << "  --threads T   workers for the pipeline run (default all but two cores)" << std::endl;
+    }
+
+    bool parse(int argc, char **argv, Options &options)
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            std::string arg = argv[i];
+            int left = argc - i - 1;
+
+            if (arg == "--size" && left >= 1)
+                options.size = atoi(argv[++i]);
+            else if (arg == "--centre" && left >= 2)
+            {
+                options.centre.x = atoi(argv[++i]);
+                options.centre.z = atoi(argv[++i]);
+            }
+            else if (arg == "--queries" && left >= 1)
+                options.queries = atoi(argv[++i]);
+            else if (arg == "--threads" && left >= 1)
+                options.threads = atoi(argv[++i]);
+            else
+                return false;
+        }
+
+        return options.size > 0 && options.queries >= 0 && options.threads >= 0;
+    }
+
+    // Calls fn for every chunk within `ring` chunks of the square, clipped to the world
+    template <typename Fn>
+    void forEachInArea(int minX, int minZ, int size, int ring, Fn fn)
+    {
+        for (int x = std::max(minX - ring, 0); x < std::min(minX + size + ring, worldWidth); x++)
+            for (int z = std::max(minZ - ring, 0); z < std::min(minZ + size + ring, worldWidth); z++)
+                fn(ChunkCoord(x, z));
+    }
+
+    Chunk *find(World &world, ChunkCoord coord)
+    {
+        auto it = world.chunks.find(coord);
+        return it == world.chunks.end() ? nullptr : it->second;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    if (!parse(argc, argv, options))
+    {
+        usage();
+        return 1;
+    }
+
+    int minX = std::max(std::min(options.centre.x - options.size / 2, worldWidth - options.size), 0);
+    int minZ = std::max(std::min(options.centre.z - options.size / 2, worldWidth - options.size), 0);
+    int size = std::min(options.size, worldWidth);
+    int voxelsPerChunk = chunkWidth * chunkWidth * chunkHeight;
+
+    Samples populate{"populate"}, caves{"caves"}, lodes{"lodes"}, trees{"trees"}, mesh{"mesh"}, raycast{"raycast"}, collision{"collision"};
+
+    // Stages by hand, in pipeline order: the square is meshed, so it and one ring are decorated, so it
+    // and two rings are generated
+    World world(1);
+    forEachInArea(minX, minZ, size, 2, [&](ChunkCoord coord)
+                  {
+        Chunk *chunk = new Chunk(&world, coord);
+        world.chunks[coord] = chunk;
+
+        populate.time([&]() { chunk->populateVoxelMap(); });
+        caves.time([&]() { world.generateCaves(chunk); });
+        lodes.time([&]() { world.generateLodes(chunk, *world.lodeSet); });
+        chunk->stage = STAGE_GENERATED; });
+
+    forEachInArea(minX, minZ, size, 1, [&](ChunkCoord coord)
+                  {
+        ChunkArea area;
+        area.centre = coord;
+        for (int dx = -1; dx <= 1; dx++)
+            for (int dz = -1; dz <= 1; dz++)
+                area.chunks[dx + 1][dz + 1] = find(world, ChunkCoord(coord.x + dx, coord.z + dz));
+
+        trees.time([&]() { world.generateTrees(area); });
+        world.chunks[coord]->stage = STAGE_DECORATED; });
+
+    long long vertices = 0;
+    forEachInArea(minX, minZ, size, 0, [&](ChunkCoord coord)
+                  {
+        Chunk *chunk = world.chunks[coord];
+        Chunk *neighbours[4] = {find(world, ChunkCoord(coord.x, coord.z + 1)), find(world, ChunkCoord(coord.x, coord.z - 1)),
+                                find(world, ChunkCoord(coord.x + 1, coord.z)), find(world, ChunkCoord(coord.x - 1, coord.z))};
+
+        mesh.time([&]() { chunk->generateMesh(neighbours); });
+        chunk->stage = STAGE_MESHED;
+
+        for (const ChunkSection &section : chunk->sections)
+            vertices += section.vertices.size() / 9; });
+
+    // Queries from random points over the meshed square, a fixed sequence every run
+    std::mt19937 random(1337);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    auto randomPoint = [&]()
+    {
+        return glm::vec3((minX + unit(random) * size) * chunkWidth, terrainMinHeight + unit(random) * (chunkHeight - terrainMinHeight),
+                         (minZ + unit(random) * size) * chunkWidth);
+    };
+    auto randomDirection = [&]()
+    {
+        return glm::normalize(glm::vec3(unit(random) - 0.5f, unit(random) - 0.5f, unit(random) - 0.5f) + glm::vec3(0.0f, 0.0f, 1e-3f));
+    };
+
+    int hits = 0;
+    for (int i = 0; i < options.queries; i++)
+    {
+        glm::vec3 origin = randomPoint();
+        glm::vec3 direction = randomDirection();
+        raycast.time([&]() { hits += world.raycast(origin, direction, 5.0f).hit ? 1 : 0; });
+    }
+
+    for (int i = 0; i < options.queries; i++)
+    {
+        // Player-sized box moving at sprinting speed for one tick
+        glm::vec3 position = randomPoint();
+        AABB box(position - glm::vec3(0.3f, 0.0f, 0.3f), position + glm::vec3(0.3f, 1.8f, 0.3f));
+        glm::vec3 velocity = randomDirection() * 8.0f;
+        collision.time([&]() { sweepAABB(world, box, velocity, 1.0f / 60.0f, 0.6f, true); });
+    }
+
+    // Held by the hand-built area: the meshed square and the rings generated around it
+    MemoryStats memory;
+    world.measureMemory(memory);
+
+    // The whole pipeline over the same square on the job system
+    double pipelineSeconds;
+    int workers;
+    {
+        World pipeline(options.threads);
+        workers = pipeline.jobs.workerCount();
+
+        Clock::time_point start = Clock::now();
+        forEachInArea(minX, minZ, size, 0, [&](ChunkCoord coord)
+                      { pipeline.requestMesh(coord); });
+        pipeline.jobs.waitIdle();
+        pipelineSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+        for (auto &pair : pipeline.chunks)
+            delete pair.second;
+        pipeline.chunks.clear();
+    }
+
+    for (auto &pair : world.chunks)
+        delete pair.second;
+    world.chunks.clear();
+
+    int meshed = size * size;
+    double generateSeconds = (populate.total() + caves.total() + lodes.total()) / 1000.0;
+
+    std::cout << std::fixed << std::setprecision(4) << "{" << std::endl;
+    std::cout << "  \"area\": {\"min_x\": " << minX << ", \"min_z\": " << minZ << ", \"size\": " << size
+              << ", \"chunk_width\": " << chunkWidth << ", \"chunk_height\": " << chunkHeight << "}," << std::endl;
+    std::cout << "  \"stages\": {" << std::endl;
+    for (const Samples *samples : {&populate, &caves, &lodes, &trees, &mesh, &raycast, &collision})
+    {
+        std::cout << "    ";
+        samples->write(std::cout);
+        std::cout << (samples != &collision ? "," : "") << std::endl;
+    }
+    std::cout << "  }," << std::endl;
+    std::cout << "  \"generate_chunks_per_s\": " << populate.ms.size() / std::max(generateSeconds, 1e-9) << "," << std::endl;
+    std::cout << "  \"generate_voxels_per_s\": " << populate.ms.size() * (double)voxelsPerChunk / std::max(generateSeconds, 1e-9) << "," << std::endl;
+    std::cout << "  \"mesh_chunks_per_s\": " << meshed / std::max(mesh.total() / 1000.0, 1e-9) << "," << std::endl;
+    std::cout << "  \"vertices_per_chunk\": " << (double)vertices / meshed << "," << std::endl;
+    std::cout << "  \"raycast_hit_rate\": " << (double)hits / std::max(options.queries, 1) << "," << std::endl;
+    std::cout << "  \"pipeline\": {\"workers\": " << workers << ", \"seconds\": " << pipelineSeconds
+              << ", \"chunks_per_s\": " << meshed / std::max(pipelineSeconds, 1e-9)
+              << ", \"voxels_per_s\": " << meshed * (double)voxelsPerChunk / std::max(pipelineSeconds, 1e-9) << "}," << std::endl;
+
+    const ChunkMemory &chunkMemory = memory.chunkTotal;
+    double chunkCount = std::max(memory.chunks, 1);
+    std::cout << "  \"memory\": {\"chunks\": " << memory.chunks << ", \"bytes\": " << memory.cpuBytes()
+              << ", \"voxel_bytes\": " << chunkMemory.voxels << ", \"edit_bytes\": " << chunkMemory.edits
+              << ", \"vertex_bytes\": " << chunkMemory.vertices << ", \"object_bytes\": " << chunkMemory.object
+              << ", \"chunk_map_bytes\": " << memory.chunkMap << ", \"queue_bytes\": " << memory.queues << ", \"profiler_bytes\": " << memory.profiler
+              << ", \"voxel_bytes_per_chunk\": " << chunkMemory.voxels / chunkCount << ", \"vertex_bytes_per_chunk\": " << chunkMemory.vertices / chunkCount
+              << ", \"largest_chunk_bytes\": " << memory.largestChunk.total() << "}" << std::endl;
+    std::cout << "}" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,202 @@
+// Generates an area of the world ahead of time into region files, so a game (or server) started on them
+// loads those chunks instead of generating them. No window: only the world generation code is linked.
+//
+//   pregen [--size N] [--centre X Z] [--out DIR] [--threads T] [--tile S]
+//
+// The area is done S x S chunks at a time. A chunk is final once the 3x3 around it is decorated, so a
+// tile also needs the two rings of chunks around it, which costs memory (about 3 MB a chunk) and the
+// generation of those rings again for the next row of tiles. Tiles already saved whole are skipped, so
+// a rerun into the same directory resumes where the last one stopped.
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <cstdlib>
+#include <chrono>
+#include <thread>
+
+#include "voxelData.h"
+#include "world.h"
+
+namespace
+{
+    struct Options
+    {
+        int size = 32;
+        ChunkCoord centre = ChunkCoord(worldWidth / 2, worldWidth / 2);
+        std::string out = saveDirectory;
+        int threads = (int)std::thread::hardware_concurrency();
+        int tile = 16;
+    };
+
+    void usage()
+    {
+        std::cout << "usage: pregen [--size N] [--centre X Z] [--out DIR] [--threads T] [--tile S]" << std::endl;
+        std::cout << "  --size N      side of the square of chunks to generate (default 32)" << std::endl;
+        std::cout << "  --centre X Z  chunk the square is centred on (default the middle of the world)" << std::endl;
+        std::cout << "  --out DIR     region file directory (default \"" << saveDirectory << "\")" << std::endl;
+        std::cout << "  --threads T   worker threads (default one per core)" << std::endl;
+        std::cout << "  --tile S      chunks per side generated at once (default 16)" << std::endl;
+    }
+
+    bool parse(int argc, char **argv, Options &options)
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            std::string arg = argv[i];
+            int left = argc - i - 1;
+
+            if (arg == "--size" && left >= 1)
+                options.size = atoi(argv[++i]);
+            else if (arg == "--centre" && left >= 2)
+            {
+                options.centre.x = atoi(argv[++i]);
+                options.centre.z = atoi(argv[++i]);
+            }
+            else if (arg == "--out" && left >= 1)
+                options.out = argv[++i];
+            else if (arg == "--threads" && left >= 1)
+                options.threads = atoi(argv[++i]);
+            else if (arg == "--tile" && left >= 1)
+                options.tile = atoi(argv[++i]);
+            else
+                return false;
+        }
+
+        return options.size > 0 && options.tile > 0 && options.threads > 0;
+    }
+
+    // Deletes the chunks for which drop returns true. Only call with no jobs pending.
+    template <typename Fn>
+    void dropChunks(World &world, Fn drop)
+    {
+        for (auto it = world.chunks.begin(); it != world.chunks.end();)
+        {
+            if (drop(it->first))
+            {
+                delete it->second;
+                it = world.chunks.erase(it);
+            }
+            else
+                it++;
+        }
+    }
+
+    // Whether every chunk of the tile was saved whole, by an earlier run into the same directory
+    bool isTileSaved(World &world, int x0, int x1, int z0, int z1)
+    {
+        std::vector<uint8_t> payload;
+        for (int x = x0; x < x1; x++)
+        {
+            for (int z = z0; z < z1; z++)
+            {
+                if (!world.regions->load(ChunkCoord(x, z), payload) || !Chunk::isWholePayload(payload))
+                    return false;
+            }
+        }
+
+        return true;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    if (!parse(argc, argv, options))
+    {
+        usage();
+        return 1;
+    }
+
+    int minX = std::max(options.centre.x - options.size / 2, 0);
+    int minZ = std::max(options.centre.z - options.size / 2, 0);
+    int maxX = std::min(options.centre.x - options.size / 2 + options.size, worldWidth); // Exclusive
+    int maxZ = std::min(options.centre.z - options.size / 2 + options.size, worldWidth);
+    if (minX >= maxX || minZ >= maxZ)
+    {
+        std::cout << "pregen: the area is outside the world (0 to " << worldWidth << " chunks)" << std::endl;
+        return 1;
+    }
+
+    World world(options.threads);
+    world.regions = std::make_unique<RegionStore>(options.out);
+
+    int total = (maxX - minX) * (maxZ - minZ);
+    std::cout << "pregen: " << (maxX - minX) << "x" << (maxZ - minZ) << " chunks from (" << minX << ", " << minZ << ") into "
+              << options.out << " on " << options.threads << " threads" << std::endl;
+
+    auto start = std::chrono::steady_clock::now();
+    int done = 0;
+    int skipped = 0; // Saved whole by an earlier run
+
+    // Tiles go along x in rows. The next tile in a row reuses the chunks the last one left along its edge,
+    // which never needed anything that was dropped, so only a new row starts from scratch.
+    for (int z0 = minZ; z0 < maxZ; z0 += options.tile)
+    {
+        int z1 = std::min(z0 + options.tile, maxZ);
+
+        for (int x0 = minX; x0 < maxX; x0 += options.tile)
+        {
+            int x1 = std::min(x0 + options.tile, maxX);
+            auto dropDone = [&](ChunkCoord coord)
+            {
+                return x1 >= maxX || coord.x < x1 - 2;
+            };
+
+            if (isTileSaved(world, x0, x1, z0, z1))
+            {
+                dropChunks(world, dropDone);
+                done += (x1 - x0) * (z1 - z0);
+                skipped += (x1 - x0) * (z1 - z0);
+                continue;
+            }
+
+            // Decorating the tile and one ring around it generates a second ring through the dependencies
+            for (int x = std::max(x0 - 1, 0); x < std::min(x1 + 1, worldWidth); x++)
+                for (int z = std::max(z0 - 1, 0); z < std::min(z1 + 1, worldWidth); z++)
+                    world.requestDecorate(ChunkCoord(x, z));
+            world.jobs.waitIdle();
+
+            for (int x = x0; x < x1; x++)
+            {
+                for (int z = z0; z < z1; z++)
+                {
+                    Chunk *chunk = world.chunks[ChunkCoord(x, z)];
+                    world.jobs.submit([chunk, &world]()
+                                      {
+                        std::vector<uint8_t> payload;
+                        chunk->writeWhole(payload);
+                        world.regions->save(chunk->coord, std::move(payload)); });
+                }
+            }
+            world.jobs.waitIdle();
+
+            dropChunks(world, dropDone);
+
+            done += (x1 - x0) * (z1 - z0);
+            float seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+            float rate = (done - skipped) / std::max(seconds, 0.001f);
+
+            std::cout << std::fixed << std::setprecision(1)
+                      << "[" << std::setw(5) << 100.0f * done / total << "%] " << done << "/" << total << " chunks, "
+                      << rate << " chunks/s, " << (long long)rate * chunkWidth * chunkWidth * chunkHeight << " voxels/s, "
+                      << "ETA " << (total - done) / rate << "s, " << world.regions->pendingWrites() << " queued for disk"
+                      << std::endl;
+        }
+    }
+
+    world.regions->flush();
+
+    float seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+    std::cout << std::fixed << std::setprecision(1)
+              << "pregen: " << total - skipped << " chunks in " << seconds << "s (" << (total - skipped) / std::max(seconds, 0.001f) << " chunks/s), "
+              << skipped << " already saved, " << world.regions->bytesWritten / 1024 << " KB written" << std::endl;
+
+    if (world.regions->pendingWrites() > 0)
+    {
+        std::cout << "pregen: " << world.regions->pendingWrites() << " chunks could not be written" << std::endl;
+        return 1;
+    }
+
+    return 0;
+}